@@ -0,0 +1,457 @@
+/*
+   Contention benchmark of the queue_x and stack_x containers.
+
+   Every run moves a fixed number of items from P producer threads to C consumer threads through one container,
+   for every combination of container, producer / consumer count, payload size and pinning asked for.
+   Each run prints one JSON object per line :
+      items_per_sec    items pushed and popped per second
+      push_ns_p50 ...  latency of push / successful pop calls, sampled, in nanoseconds
+      allocs_per_item  calls to operator new per item, over all threads
+      push_items_per_call, pop_items_per_call
+                       items moved per push / pop call, empty pops included : with --batch and a container
+                       taking a lock, like thread_safe_queue, the items moved per lock acquisition
+
+   With --batch N above 1, producers push N items at a time with push_range and consumers pop up to N with pop_bulk,
+   only the containers offering them are run.
+
+   Usage :
+      container_bench [--items N] [--producers 1,2,4] [--consumers 1,2,4] [--payloads 8,64,256,1024]
+                      [--pin off,on] [--containers name,...] [--batch N]
+*/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+#include "containers.h"
+
+/*-------------------------------- allocation counting --------------------------------*/
+
+// Per thread, so that counting adds no contention of its own
+static thread_local size_t allocation_count = 0;
+
+void* operator new(size_t size)
+{
+   ++allocation_count;
+   if(void* p = std::malloc(size == 0 ? 1 : size))
+   {
+      return p;
+   }
+   throw std::bad_alloc();
+}
+
+// Over-aligned types, like the alignas(64) segments of lock_free_queue, come through these
+void* operator new(size_t size, std::align_val_t alignment)
+{
+   ++allocation_count;
+   const size_t align = static_cast<size_t>(alignment);
+   // aligned_alloc wants a size multiple of the alignment
+   if(void* p = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) / align * align))
+   {
+      return p;
+   }
+   throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+   std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+   std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+   std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+   std::free(p);
+}
+
+/*-------------------------------- configuration --------------------------------*/
+
+struct config
+{
+   size_t items = 1000000;
+   std::vector<int> producers{1, 2, 4};
+   std::vector<int> consumers{1, 2, 4};
+   std::vector<int> payloads{8, 64, 256, 1024};
+   std::vector<int> pinning{0, 1};
+   std::vector<std::string> containers;
+   size_t batch = 1;
+};
+
+static std::vector<std::string> split(const char* text)
+{
+   std::vector<std::string> parts;
+   std::string part;
+   for(const char* c = text; ; ++c)
+   {
+      if(*c == ',' || *c == '\0')
+      {
+         if(!part.empty())
+         {
+            parts.push_back(part);
+         }
+         part.clear();
+         if(*c == '\0')
+         {
+            break;
+         }
+      }
+      else
+      {
+         part += *c;
+      }
+   }
+   return parts;
+}
+
+static std::vector<int> split_ints(const char* text)
+{
+   std::vector<int> values;
+   for(const std::string& part : split(text))
+   {
+      values.push_back(part == "on" ? 1 : part == "off" ? 0 : std::atoi(part.c_str()));
+   }
+   return values;
+}
+
+static bool parse_args(int argc, char** argv, config* cfg)
+{
+   for(int i = 1; i + 1 < argc; i += 2)
+   {
+      const std::string flag = argv[i];
+      if(flag == "--items")
+      {
+         cfg->items = std::strtoull(argv[i + 1], nullptr, 10);
+      }
+      else if(flag == "--producers")
+      {
+         cfg->producers = split_ints(argv[i + 1]);
+      }
+      else if(flag == "--consumers")
+      {
+         cfg->consumers = split_ints(argv[i + 1]);
+      }
+      else if(flag == "--payloads")
+      {
+         cfg->payloads = split_ints(argv[i + 1]);
+      }
+      else if(flag == "--pin")
+      {
+         cfg->pinning = split_ints(argv[i + 1]);
+      }
+      else if(flag == "--containers")
+      {
+         cfg->containers = split(argv[i + 1]);
+      }
+      else if(flag == "--batch")
+      {
+         cfg->batch = std::max<size_t>(1, std::strtoull(argv[i + 1], nullptr, 10));
+      }
+      else
+      {
+         return false;
+      }
+   }
+   return argc % 2 == 1;
+}
+
+/*-------------------------------- measurement --------------------------------*/
+
+// Items carry a payload of Size bytes, the first ones being the sequence number
+template<size_t Size>
+struct payload
+{
+   std::array<char, Size> bytes{};
+};
+
+static constexpr size_t sample_every = 64;
+
+struct thread_result
+{
+   std::vector<uint32_t> latencies;
+   size_t allocations = 0;
+   size_t calls = 0;
+};
+
+// Push count values, one at a time unless the adapter can take them all at once
+template<typename Adapter, typename T>
+static void push_values(Adapter& adapter, T* values, size_t count)
+{
+   if constexpr(Adapter::bulk)
+   {
+      if(count > 1)
+      {
+         adapter.push_range(values, values + count);
+         return;
+      }
+   }
+   adapter.push(std::move(values[0]));
+}
+
+// Pop up to max values, returning how many
+template<typename Adapter, typename T>
+static size_t pop_values(Adapter& adapter, T* values, size_t max)
+{
+   if constexpr(Adapter::bulk)
+   {
+      if(max > 1)
+      {
+         return adapter.pop_bulk(values, max);
+      }
+   }
+   return adapter.try_pop(values[0]) ? 1 : 0;
+}
+
+static void pin_thread(int index)
+{
+   cpu_set_t allowed;
+   CPU_ZERO(&allowed);
+   if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0)
+   {
+      return;
+   }
+   int target = index % CPU_COUNT(&allowed);
+   for(int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+   {
+      if(CPU_ISSET(cpu, &allowed) && target-- == 0)
+      {
+         cpu_set_t set;
+         CPU_ZERO(&set);
+         CPU_SET(cpu, &set);
+         pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+         return;
+      }
+   }
+}
+
+static uint64_t percentile(std::vector<uint32_t>& samples, double p)
+{
+   if(samples.empty())
+   {
+      return 0;
+   }
+   const size_t index = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+   std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+   return samples[index];
+}
+
+static uint32_t elapsed_ns(std::chrono::steady_clock::time_point start)
+{
+   const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+   return static_cast<uint32_t>(std::min<int64_t>(ns, UINT32_MAX));
+}
+
+template<typename Adapter, size_t Size>
+static void run(const config& cfg, int producers, int consumers, bool pinned)
+{
+   using item = payload<Size>;
+   Adapter adapter;
+
+   const size_t per_producer = cfg.items / producers;
+   const size_t total = per_producer * producers;
+   std::atomic<size_t> popped{0};
+   std::atomic<int> ready{0};
+   std::atomic<bool> go{false};
+   std::vector<thread_result> push_results(producers), pop_results(consumers);
+
+   const auto start_barrier = [&](int index, thread_result& result, size_t ops)
+   {
+      // Reserved upfront so that sampling doesn't allocate during the run
+      result.latencies.reserve(ops / sample_every + 1);
+      if(pinned)
+      {
+         pin_thread(index);
+      }
+      ready.fetch_add(1);
+      while(!go.load(std::memory_order_acquire))
+      {
+         std::this_thread::yield();
+      }
+      result.allocations = allocation_count;
+   };
+
+   std::vector<std::thread> threads;
+   for(int p = 0; p < producers; p++)
+   {
+      threads.emplace_back([&, p]
+      {
+         thread_result& result = push_results[p];
+         std::vector<item> values(cfg.batch);
+         start_barrier(p, result, per_producer);
+         for(size_t i = 0; i < per_producer; )
+         {
+            const size_t count = std::min(cfg.batch, per_producer - i);
+            for(size_t k = 0; k < count; k++)
+            {
+               const size_t sequence = i + k;
+               std::memcpy(values[k].bytes.data(), &sequence, std::min(sizeof(sequence), Size));
+            }
+            if(result.calls++ % sample_every == 0)
+            {
+               const auto start = std::chrono::steady_clock::now();
+               push_values(adapter, values.data(), count);
+               result.latencies.push_back(elapsed_ns(start));
+            }
+            else
+            {
+               push_values(adapter, values.data(), count);
+            }
+            i += count;
+         }
+         result.allocations = allocation_count - result.allocations;
+      });
+   }
+   for(int c = 0; c < consumers; c++)
+   {
+      threads.emplace_back([&, c]
+      {
+         thread_result& result = pop_results[c];
+         std::vector<item> values(cfg.batch);
+         start_barrier(producers + c, result, total);
+         while(popped.load(std::memory_order_relaxed) < total)
+         {
+            const bool sampled = result.calls++ % sample_every == 0;
+            const auto start = sampled ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+            if(const size_t count = pop_values(adapter, values.data(), cfg.batch))
+            {
+               popped.fetch_add(count, std::memory_order_relaxed);
+               if(sampled && result.latencies.size() < result.latencies.capacity())
+               {
+                  result.latencies.push_back(elapsed_ns(start));
+               }
+            }
+            else
+            {
+               std::this_thread::yield();
+            }
+         }
+         result.allocations = allocation_count - result.allocations;
+      });
+   }
+
+   while(ready.load() != producers + consumers)
+   {
+      std::this_thread::yield();
+   }
+   const auto start = std::chrono::steady_clock::now();
+   go.store(true, std::memory_order_release);
+   for(std::thread& t : threads)
+   {
+      t.join();
+   }
+   const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   std::vector<uint32_t> push_latencies, pop_latencies;
+   size_t allocations = 0, push_calls = 0, pop_calls = 0;
+   for(thread_result& result : push_results)
+   {
+      push_latencies.insert(push_latencies.end(), result.latencies.begin(), result.latencies.end());
+      allocations += result.allocations;
+      push_calls += result.calls;
+   }
+   for(thread_result& result : pop_results)
+   {
+      pop_latencies.insert(pop_latencies.end(), result.latencies.begin(), result.latencies.end());
+      allocations += result.allocations;
+      pop_calls += result.calls;
+   }
+
+   std::printf("{\"container\":\"%s\",\"producers\":%d,\"consumers\":%d,\"payload\":%zu,\"pinned\":%s,"
+               "\"items\":%zu,\"seconds\":%.6f,\"items_per_sec\":%.0f,"
+               "\"push_ns_p50\":%llu,\"push_ns_p99\":%llu,\"push_ns_p999\":%llu,"
+               "\"pop_ns_p50\":%llu,\"pop_ns_p99\":%llu,\"pop_ns_p999\":%llu,"
+               "\"allocs_per_item\":%.3f,\"batch\":%zu,\"push_items_per_call\":%.2f,\"pop_items_per_call\":%.2f}\n",
+               Adapter::name, producers, consumers, Size, pinned ? "true" : "false",
+               total, seconds, total / seconds,
+               (unsigned long long)percentile(push_latencies, 0.5),
+               (unsigned long long)percentile(push_latencies, 0.99),
+               (unsigned long long)percentile(push_latencies, 0.999),
+               (unsigned long long)percentile(pop_latencies, 0.5),
+               (unsigned long long)percentile(pop_latencies, 0.99),
+               (unsigned long long)percentile(pop_latencies, 0.999),
+               static_cast<double>(allocations) / total, cfg.batch,
+               static_cast<double>(total) / push_calls, static_cast<double>(total) / pop_calls);
+   std::fflush(stdout);
+}
+
+/*-------------------------------- sweep --------------------------------*/
+
+template<size_t Size>
+struct sweep
+{
+   const config& cfg;
+
+   template<typename Adapter>
+   void visit()
+   {
+      if(!cfg.containers.empty() &&
+         std::find(cfg.containers.begin(), cfg.containers.end(), Adapter::name) == cfg.containers.end())
+      {
+         return;
+      }
+      for(int producers : cfg.producers)
+      {
+         for(int consumers : cfg.consumers)
+         {
+            if(producers <= 0 || consumers <= 0 || (Adapter::spsc && (producers != 1 || consumers != 1)) ||
+               (cfg.batch > 1 && !Adapter::bulk))
+            {
+               continue;
+            }
+            for(int pinned : cfg.pinning)
+            {
+               run<Adapter, Size>(cfg, producers, consumers, pinned != 0);
+            }
+         }
+      }
+   }
+};
+
+template<size_t Size>
+static void sweep_payload(const config& cfg)
+{
+   sweep<Size> visitor{cfg};
+   for_each_container<payload<Size>>(visitor);
+}
+
+int main(int argc, char** argv)
+{
+   config cfg;
+   if(!parse_args(argc, argv, &cfg))
+   {
+      std::fprintf(stderr, "usage: %s [--items N] [--producers 1,2,4] [--consumers 1,2,4] [--payloads 8,64,256,1024] "
+                           "[--pin off,on] [--containers name,...] [--batch N]\n", argv[0]);
+      return 1;
+   }
+
+   for(int size : cfg.payloads)
+   {
+      switch(size)
+      {
+         case 8: sweep_payload<8>(cfg); break;
+         case 64: sweep_payload<64>(cfg); break;
+         case 256: sweep_payload<256>(cfg); break;
+         case 1024: sweep_payload<1024>(cfg); break;
+         default: std::fprintf(stderr, "unsupported payload size %d, use 8, 64, 256 or 1024\n", size); break;
+      }
+   }
+   return 0;
+}
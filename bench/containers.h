@@ -0,0 +1,150 @@
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include "thread_safe_queue.h"
+#include "lock_free_queue.h"
+#include "spsc_ring_buffer.h"
+#include "lock_free_stack.h"
+#include "hazard_pointer_stack.h"
+#include "epoch_stack.h"
+
+/*
+   Adapters giving every benchmarked container the same interface :
+
+      template<typename T>
+      struct adapter
+      {
+         static constexpr const char* name = "...";
+         // Only one producer and one consumer may use it
+         static constexpr bool spsc = false;
+         // push_range and pop_bulk are available, each takes the container lock once
+         static constexpr bool bulk = false;
+         adapter();
+         void push(T&& value);
+         bool try_pop(T& value);
+         // bulk only : move the values in, move up to max values out, returning the number moved
+         size_t push_range(T* first, T* last);
+         size_t pop_bulk(T* out, size_t max);
+      };
+
+   To benchmark a new container, write its adapter here and add it to for_each_container().
+*/
+
+template<typename T>
+struct thread_safe_queue_adapter
+{
+   static constexpr const char* name = "thread_safe_queue";
+   static constexpr bool spsc = false;
+   static constexpr bool bulk = true;
+
+   thread_safe_queue<T> container;
+
+   void push(T&& value) { container.push(std::move(value)); }
+   bool try_pop(T& value) { return container.try_pop(value); }
+   size_t push_range(T* first, T* last)
+   {
+      return container.push_range(std::make_move_iterator(first), std::make_move_iterator(last));
+   }
+   size_t pop_bulk(T* out, size_t max) { return container.pop_bulk(out, max); }
+};
+
+template<typename T>
+struct lock_free_queue_adapter
+{
+   static constexpr const char* name = "lock_free_queue";
+   static constexpr bool spsc = false;
+   static constexpr bool bulk = false;
+
+   lock_free_queue<T> container;
+
+   void push(T&& value) { container.push(std::move(value)); }
+   bool try_pop(T& value) { return container.try_pop(value); }
+};
+
+template<typename T>
+struct spsc_ring_buffer_adapter
+{
+   static constexpr const char* name = "spsc_ring_buffer";
+   static constexpr bool spsc = true;
+   static constexpr bool bulk = false;
+
+   spsc_ring_buffer<T> container{4096};
+
+   void push(T&& value) { container.push(std::move(value)); }
+   bool try_pop(T& value) { return container.try_pop(value); }
+};
+
+template<typename T>
+struct lock_free_stack_adapter
+{
+   static constexpr const char* name = "lock_free_stack";
+   static constexpr bool spsc = false;
+   static constexpr bool bulk = false;
+
+   // Recycled nodes, so that steady-state push / pop don't allocate
+   lock_free_stack<T> container{4096};
+
+   void push(T&& value) { container.push(std::move(value)); }
+   bool try_pop(T& value) { return container.try_pop(value); }
+};
+
+template<typename T>
+struct hazard_pointer_stack_adapter
+{
+   static constexpr const char* name = "hazard_pointer_stack";
+   static constexpr bool spsc = false;
+   static constexpr bool bulk = false;
+
+   hazard_pointer_stack<T> container;
+
+   void push(T&& value) { container.push(std::move(value)); }
+   bool try_pop(T& value) { return container.pop(value); }
+};
+
+template<typename T>
+struct epoch_stack_adapter
+{
+   static constexpr const char* name = "epoch_stack";
+   static constexpr bool spsc = false;
+   static constexpr bool bulk = false;
+
+   epoch_stack<T> container;
+
+   void push(T&& value) { container.push(std::move(value)); }
+   bool try_pop(T& value) { return container.pop(value); }
+};
+
+// Consumers behave like ThreadPool workers : online, with a quiescent point after every pop
+template<typename T>
+struct epoch_stack_online_adapter
+{
+   static constexpr const char* name = "epoch_stack_online";
+   static constexpr bool spsc = false;
+   static constexpr bool bulk = false;
+
+   epoch_stack<T> container;
+
+   void push(T&& value) { container.push(std::move(value)); }
+   bool try_pop(T& value)
+   {
+      epoch_online();
+      const bool popped = container.pop(value);
+      epoch_quiescent();
+      return popped;
+   }
+};
+
+// Call visitor.template visit<adapter<T>>() for every container
+template<typename T, typename Visitor>
+void for_each_container(Visitor& visitor)
+{
+   visitor.template visit<thread_safe_queue_adapter<T>>();
+   visitor.template visit<lock_free_queue_adapter<T>>();
+   visitor.template visit<spsc_ring_buffer_adapter<T>>();
+   visitor.template visit<lock_free_stack_adapter<T>>();
+   visitor.template visit<hazard_pointer_stack_adapter<T>>();
+   visitor.template visit<epoch_stack_adapter<T>>();
+   visitor.template visit<epoch_stack_online_adapter<T>>();
+}
@@ -0,0 +1,380 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "../threadpool/header/macros.h"
+#include "../reclaim_x/hazard_pointer.h"
+
+/*
+   Unbounded lock-free multi-producer / multi-consumer FIFO queue, with the interface of thread_safe_queue.
+
+   Values live in fixed-size segments linked from head to tail, so there is one allocation per segment_size values.
+   A push takes a ticket with a fetch-and-add on enq_index of the tail segment and writes its cell,
+   a pop takes a ticket on deq_index of the head segment and claims the cell with the same number.
+   A consumer reaching a cell before its producer marks it taken, the producer then retries with another ticket.
+   Tickets beyond the end of a segment move on to the next one, the producer which runs out first appends it.
+
+   close() ends the stream : pushes fail from then on, and consumers drain what is left
+   then get an end-of-stream result instead of blocking.
+
+   Reclamation : every operation protects the segment it works on with a hazard pointer (see reclaim_x/hazard_pointer.h).
+   A segment is unlinked once all its cells have been claimed and handed to hazard_retire, which frees it as soon as
+   no operation protects it anymore. So besides the segments holding values, the memory held is bounded by the
+   per-thread retired lists, whatever the contention.
+*/
+template<typename T, size_t segment_size = 256>
+class lock_free_queue
+{
+   static_assert(segment_size > 0, "segments hold at least one value");
+
+private:
+   enum cell_state : uint32_t
+   {
+      cell_empty = 0,
+      cell_full = 1,
+      cell_taken = 2
+   };
+
+   struct cell
+   {
+      std::atomic<uint32_t> state{cell_empty};
+      typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+      T& value() { return *reinterpret_cast<T*>(&storage); }
+   };
+
+   struct segment
+   {
+      alignas(64) std::atomic<size_t> enq_index{0};
+      alignas(64) std::atomic<size_t> deq_index{0};
+      alignas(64) std::atomic<segment*> next{nullptr};
+      cell cells[segment_size];
+
+      void reset();
+   };
+
+   static constexpr int claim_spin_count = 64;
+   static constexpr int wait_spin_count = 256;
+
+   alignas(64) std::atomic<segment*> head;
+   alignas(64) std::atomic<segment*> tail;
+
+   // A segment a producer allocated but lost the race to append, kept for the next append
+   alignas(64) std::atomic<segment*> spare;
+   std::atomic<bool> closed;
+
+   std::mutex wait_mutex;
+   std::condition_variable wait_cond;
+   std::atomic<int> waiters;
+
+private:
+   segment* new_segment();
+   void keep_spare(segment*);
+   void notify_waiters();
+
+   // Hand the popped value to sink, as an rvalue
+   template<typename Sink>
+   bool try_pop_into(Sink&& sink);
+   // False at end of stream
+   template<typename Sink>
+   bool wait_pop_into(Sink&& sink);
+
+public:
+   lock_free_queue();
+   lock_free_queue(const lock_free_queue&) = delete;
+   lock_free_queue& operator=(const lock_free_queue&) = delete;
+   ~lock_free_queue();
+
+   std::shared_ptr<T> try_pop();
+   bool try_pop(T&);
+
+   // Return nullptr / false at end of stream : the queue is closed and drained
+   std::shared_ptr<T> wait_and_pop();
+   bool wait_and_pop(T&);
+
+   // Return false if the queue is closed
+   bool push(T);
+
+   // Wake every waiter, pending values can still be popped.
+   // A push racing with close() may still succeed after the waiters returned, its value stays available to try_pop.
+   void close();
+   bool is_closed();
+
+   // Approximate while other threads push or pop
+   bool empty();
+};
+
+template<typename T, size_t segment_size>
+void
+lock_free_queue<T, segment_size>::segment::reset()
+{
+   enq_index.store(0, std::memory_order_relaxed);
+   deq_index.store(0, std::memory_order_relaxed);
+   next.store(nullptr, std::memory_order_relaxed);
+   for(cell& c : cells)
+   {
+      c.state.store(cell_empty, std::memory_order_relaxed);
+   }
+}
+
+template<typename T, size_t segment_size>
+lock_free_queue<T, segment_size>::lock_free_queue():
+   head(new segment), tail(head.load()), spare(nullptr), closed(false), waiters(0)
+{}
+
+template<typename T, size_t segment_size>
+lock_free_queue<T, segment_size>::~lock_free_queue()
+{
+   segment* seg = head.load();
+   while(seg != nullptr)
+   {
+      segment* const next = seg->next.load();
+      for(cell& c : seg->cells)
+      {
+         if(c.state.load(std::memory_order_relaxed) == cell_full)
+         {
+            c.value().~T();
+         }
+      }
+      delete seg;
+      seg = next;
+   }
+   // Retired segments are freed by hazard_retire, they hold no value anymore
+   delete spare.load();
+}
+
+template<typename T, size_t segment_size>
+typename lock_free_queue<T, segment_size>::segment*
+lock_free_queue<T, segment_size>::new_segment()
+{
+   segment* const seg = spare.exchange(nullptr);
+   return seg != nullptr ? seg : new segment;
+}
+
+// A segment which was never linked, no other thread can have seen it
+template<typename T, size_t segment_size>
+void
+lock_free_queue<T, segment_size>::keep_spare(segment* seg)
+{
+   seg->reset();
+   segment* expected = nullptr;
+   if(!spare.compare_exchange_strong(expected, seg))
+   {
+      delete seg;
+   }
+}
+
+template<typename T, size_t segment_size>
+void
+lock_free_queue<T, segment_size>::notify_waiters()
+{
+   if(waiters.load() != 0)
+   {
+      std::lock_guard<std::mutex> lock(wait_mutex);
+      wait_cond.notify_one();
+   }
+}
+
+template<typename T, size_t segment_size>
+bool
+lock_free_queue<T, segment_size>::push(T new_value)
+{
+   if(closed.load())
+   {
+      return false;
+   }
+   {
+      hazard_pointer hp;
+      for(;;)
+      {
+         segment* seg = hp.protect(tail);
+         const size_t index = seg->enq_index.fetch_add(1);
+         if(index < segment_size)
+         {
+            cell& c = seg->cells[index];
+            ::new (&c.storage) T(std::move(new_value));
+            uint32_t expected = cell_empty;
+            if(c.state.compare_exchange_strong(expected, cell_full))
+            {
+               break;
+            }
+            // A consumer gave up on the cell, take the value back and get another ticket
+            new_value = std::move(c.value());
+            c.value().~T();
+            continue;
+         }
+
+         segment* next = seg->next.load();
+         if(next == nullptr)
+         {
+            segment* const fresh = new_segment();
+            ::new (&fresh->cells[0].storage) T(std::move(new_value));
+            fresh->cells[0].state.store(cell_full, std::memory_order_relaxed);
+            fresh->enq_index.store(1, std::memory_order_relaxed);
+            if(seg->next.compare_exchange_strong(next, fresh))
+            {
+               tail.compare_exchange_strong(seg, fresh);
+               break;
+            }
+            new_value = std::move(fresh->cells[0].value());
+            fresh->cells[0].value().~T();
+            keep_spare(fresh);
+         }
+         // Help the producer which appended the next segment.
+         // The tail never falls behind the head, so while it is still on seg, next can't have been retired
+         tail.compare_exchange_strong(seg, next);
+      }
+   }
+   notify_waiters();
+   return true;
+}
+
+template<typename T, size_t segment_size>
+template<typename Sink>
+bool
+lock_free_queue<T, segment_size>::try_pop_into(Sink&& sink)
+{
+   hazard_pointer hp;
+   for(;;)
+   {
+      segment* seg = hp.protect(head);
+      const size_t deq_index = seg->deq_index.load();
+      if(deq_index >= seg->enq_index.load() && deq_index < segment_size)
+      {
+         return false;
+      }
+
+      const size_t index = seg->deq_index.fetch_add(1);
+      if(index < segment_size)
+      {
+         cell& c = seg->cells[index];
+         // The producer holding the ticket is likely writing the cell, give it a moment
+         for(int i = 0; i < claim_spin_count && c.state.load(std::memory_order_acquire) == cell_empty; i++)
+         {
+            ARROW_CPU_PAUSE();
+         }
+         if(c.state.exchange(cell_taken) == cell_full)
+         {
+            // The value must be out of the cell before hp lets the segment be reclaimed
+            struct value_destroyer
+            {
+               T& value;
+               ~value_destroyer() { value.~T(); }
+            } destroyer{c.value()};
+            sink(std::move(c.value()));
+            return true;
+         }
+         continue;
+      }
+
+      segment* next = seg->next.load();
+      if(next == nullptr)
+      {
+         return false;
+      }
+      // The tail must not be left on a segment about to be retired
+      segment* expected = seg;
+      tail.compare_exchange_strong(expected, next);
+      if(head.compare_exchange_strong(seg, next))
+      {
+         hp.reset_protection();
+         hazard_retire(seg);
+      }
+   }
+}
+
+template<typename T, size_t segment_size>
+bool
+lock_free_queue<T, segment_size>::try_pop(T& value)
+{
+   return try_pop_into([&](T&& popped){value = std::move(popped);});
+}
+
+template<typename T, size_t segment_size>
+std::shared_ptr<T>
+lock_free_queue<T, segment_size>::try_pop()
+{
+   std::shared_ptr<T> result;
+   try_pop_into([&](T&& popped){result = std::make_shared<T>(std::move(popped));});
+   return result;
+}
+
+/*
+   The waiter registers in waiters before its last try_pop, and a producer reads waiters after publishing its value :
+   either the try_pop sees the value or the producer sees the waiter and wakes it under wait_mutex.
+   close() sets closed under wait_mutex, so a waiter which saw it unset is woken as well.
+   Once closed, a last try_pop picks up the values pushed before it.
+*/
+template<typename T, size_t segment_size>
+template<typename Sink>
+bool
+lock_free_queue<T, segment_size>::wait_pop_into(Sink&& sink)
+{
+   for(int i = 0; i < wait_spin_count && !closed.load(); i++)
+   {
+      if(try_pop_into(sink))
+      {
+         return true;
+      }
+      ARROW_CPU_PAUSE();
+   }
+
+   bool popped = false;
+   {
+      std::unique_lock<std::mutex> lock(wait_mutex);
+      waiters.fetch_add(1);
+      wait_cond.wait(lock, [&]{return (popped = try_pop_into(sink)) || closed.load();});
+      waiters.fetch_sub(1);
+   }
+   return popped || try_pop_into(sink);
+}
+
+template<typename T, size_t segment_size>
+bool
+lock_free_queue<T, segment_size>::wait_and_pop(T& value)
+{
+   return wait_pop_into([&](T&& popped){value = std::move(popped);});
+}
+
+template<typename T, size_t segment_size>
+std::shared_ptr<T>
+lock_free_queue<T, segment_size>::wait_and_pop()
+{
+   std::shared_ptr<T> result;
+   wait_pop_into([&](T&& popped){result = std::make_shared<T>(std::move(popped));});
+   return result;
+}
+
+template<typename T, size_t segment_size>
+void
+lock_free_queue<T, segment_size>::close()
+{
+   {
+      std::lock_guard<std::mutex> lock(wait_mutex);
+      closed.store(true);
+   }
+   wait_cond.notify_all();
+}
+
+template<typename T, size_t segment_size>
+bool
+lock_free_queue<T, segment_size>::is_closed()
+{
+   return closed.load();
+}
+
+template<typename T, size_t segment_size>
+bool
+lock_free_queue<T, segment_size>::empty()
+{
+   hazard_pointer hp;
+   segment* const seg = hp.protect(head);
+   const size_t deq_index = seg->deq_index.load();
+   return deq_index >= seg->enq_index.load() && (deq_index < segment_size || seg->next.load() == nullptr);
+}
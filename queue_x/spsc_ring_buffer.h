@@ -0,0 +1,358 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../threadpool/header/macros.h"
+
+/*
+   Bounded single-producer / single-consumer ring buffer.
+   Exactly one thread pushes and one thread pops, no locks and no allocation after construction.
+
+   head is written by the consumer only and tail by the producer only, each on its own cache line
+   together with a cached copy of the other index : a side reads the other index (a cache miss)
+   only when its cached copy says the buffer is full / empty.
+
+   read_span / write_span expose contiguous slots of the buffer to process values in place,
+   commit_read / commit_write then publish them.
+
+   A buffer constructed with blocking = true parks a waiting side on a futex instead of spinning,
+   at the cost of a fence on every commit to check whether the other side is asleep.
+*/
+template<typename T>
+class spsc_ring_buffer
+{
+   static_assert(std::is_default_constructible<T>::value, "slots are constructed upfront");
+
+public:
+   // Contiguous slots of the buffer
+   struct span
+   {
+      T* data;
+      size_t size;
+
+      T* begin() const { return data; }
+      T* end() const { return data + size; }
+      bool empty() const { return size == 0; }
+   };
+
+private:
+   static constexpr size_t cache_line = 64;
+   static constexpr int spin_count = 256;
+
+   // Written by the consumer
+   struct alignas(cache_line) consumer_side
+   {
+      std::atomic<size_t> head{0};
+      size_t cached_tail = 0;
+      std::atomic<uint32_t> sleeping{0};
+   };
+
+   // Written by the producer
+   struct alignas(cache_line) producer_side
+   {
+      std::atomic<size_t> tail{0};
+      size_t cached_head = 0;
+      std::atomic<uint32_t> sleeping{0};
+   };
+
+   const size_t capacity;
+   const size_t mask;
+   const bool blocking;
+   std::unique_ptr<T[]> slots;
+
+   consumer_side consumer;
+   producer_side producer;
+
+private:
+   static size_t round_up_capacity(size_t capacity);
+   static void futex_wait(std::atomic<uint32_t>* word, uint32_t expected);
+   static void futex_wake(std::atomic<uint32_t>* word);
+
+   size_t readable();
+   size_t writable();
+   void wake(std::atomic<uint32_t>* sleeping);
+   void sleep(std::atomic<uint32_t>* sleeping, bool (spsc_ring_buffer::*ready)());
+   bool has_data() { return readable() != 0; }
+   bool has_space() { return writable() != 0; }
+
+public:
+   // The capacity is rounded up to a power of two
+   explicit spsc_ring_buffer(size_t capacity, bool blocking = false);
+   spsc_ring_buffer(const spsc_ring_buffer&) = delete;
+   spsc_ring_buffer& operator=(const spsc_ring_buffer&) = delete;
+
+   // Producer side
+
+   // Return false if the buffer is full, new_value is then left untouched
+   bool try_push(T&& new_value);
+   bool try_push(const T& new_value);
+   // Wait while the buffer is full
+   void push(T new_value);
+
+   // Free slots, at most max, up to the end of the buffer : call again after commit_write to get the rest
+   span write_span(size_t max);
+   void commit_write(size_t count);
+   // Wait until write_span returns at least one slot
+   void wait_for_space();
+
+   // Consumer side
+
+   bool try_pop(T& value);
+   // Wait while the buffer is empty
+   void wait_and_pop(T& value);
+
+   // Readable values, at most max, up to the end of the buffer
+   span read_span(size_t max);
+   void commit_read(size_t count);
+   // Wait until read_span returns at least one value
+   void wait_for_data();
+
+   // Approximate when called from a third thread
+   bool empty();
+   size_t size();
+   size_t get_capacity() const { return capacity; }
+};
+
+template<typename T>
+size_t
+spsc_ring_buffer<T>::round_up_capacity(size_t capacity)
+{
+   size_t rounded = 1;
+   while(rounded < capacity)
+   {
+      rounded <<= 1;
+   }
+   return rounded;
+}
+
+template<typename T>
+spsc_ring_buffer<T>::spsc_ring_buffer(size_t capacity, bool blocking):
+   capacity(round_up_capacity(capacity)), mask(this->capacity - 1), blocking(blocking), slots(new T[this->capacity])
+{}
+
+template<typename T>
+void
+spsc_ring_buffer<T>::futex_wait(std::atomic<uint32_t>* word, uint32_t expected)
+{
+   static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs a plain 32-bit word");
+   syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+template<typename T>
+void
+spsc_ring_buffer<T>::futex_wake(std::atomic<uint32_t>* word)
+{
+   syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+// Called by the consumer
+template<typename T>
+size_t
+spsc_ring_buffer<T>::readable()
+{
+   const size_t head = consumer.head.load(std::memory_order_relaxed);
+   if(consumer.cached_tail == head)
+   {
+      consumer.cached_tail = producer.tail.load(std::memory_order_acquire);
+   }
+   return consumer.cached_tail - head;
+}
+
+// Called by the producer
+template<typename T>
+size_t
+spsc_ring_buffer<T>::writable()
+{
+   const size_t tail = producer.tail.load(std::memory_order_relaxed);
+   if(tail - producer.cached_head == capacity)
+   {
+      producer.cached_head = consumer.head.load(std::memory_order_acquire);
+   }
+   return capacity - (tail - producer.cached_head);
+}
+
+/*
+   The fences pair with the ones in sleep() : either the sleeper sees the index we just published,
+   or we see its sleeping flag.
+*/
+template<typename T>
+void
+spsc_ring_buffer<T>::wake(std::atomic<uint32_t>* sleeping)
+{
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if(sleeping->load(std::memory_order_relaxed) != 0)
+   {
+      sleeping->store(0, std::memory_order_relaxed);
+      futex_wake(sleeping);
+   }
+}
+
+template<typename T>
+void
+spsc_ring_buffer<T>::sleep(std::atomic<uint32_t>* sleeping, bool (spsc_ring_buffer::*ready)())
+{
+   for(int i = 0; i < spin_count; i++)
+   {
+      if((this->*ready)())
+      {
+         return;
+      }
+      ARROW_CPU_PAUSE();
+   }
+   if(!blocking)
+   {
+      std::this_thread::yield();
+      return;
+   }
+
+   sleeping->store(1, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   if(!(this->*ready)())
+   {
+      // Returns right away if the other side cleared the flag in the meantime
+      futex_wait(sleeping, 1);
+   }
+   sleeping->store(0, std::memory_order_relaxed);
+}
+
+template<typename T>
+typename spsc_ring_buffer<T>::span
+spsc_ring_buffer<T>::write_span(size_t max)
+{
+   const size_t tail = producer.tail.load(std::memory_order_relaxed);
+   const size_t count = std::min(std::min(max, writable()), capacity - (tail & mask));
+   return span{slots.get() + (tail & mask), count};
+}
+
+template<typename T>
+void
+spsc_ring_buffer<T>::commit_write(size_t count)
+{
+   producer.tail.store(producer.tail.load(std::memory_order_relaxed) + count, std::memory_order_release);
+   if(blocking)
+   {
+      wake(&consumer.sleeping);
+   }
+}
+
+template<typename T>
+void
+spsc_ring_buffer<T>::wait_for_space()
+{
+   while(!has_space())
+   {
+      sleep(&producer.sleeping, &spsc_ring_buffer::has_space);
+   }
+}
+
+template<typename T>
+bool
+spsc_ring_buffer<T>::try_push(T&& new_value)
+{
+   const span slot = write_span(1);
+   if(slot.empty())
+   {
+      return false;
+   }
+   *slot.data = std::move(new_value);
+   commit_write(1);
+   return true;
+}
+
+template<typename T>
+bool
+spsc_ring_buffer<T>::try_push(const T& new_value)
+{
+   const span slot = write_span(1);
+   if(slot.empty())
+   {
+      return false;
+   }
+   *slot.data = new_value;
+   commit_write(1);
+   return true;
+}
+
+template<typename T>
+void
+spsc_ring_buffer<T>::push(T new_value)
+{
+   wait_for_space();
+   try_push(std::move(new_value));
+}
+
+template<typename T>
+typename spsc_ring_buffer<T>::span
+spsc_ring_buffer<T>::read_span(size_t max)
+{
+   const size_t head = consumer.head.load(std::memory_order_relaxed);
+   const size_t count = std::min(std::min(max, readable()), capacity - (head & mask));
+   return span{slots.get() + (head & mask), count};
+}
+
+template<typename T>
+void
+spsc_ring_buffer<T>::commit_read(size_t count)
+{
+   consumer.head.store(consumer.head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+   if(blocking)
+   {
+      wake(&producer.sleeping);
+   }
+}
+
+template<typename T>
+void
+spsc_ring_buffer<T>::wait_for_data()
+{
+   while(!has_data())
+   {
+      sleep(&consumer.sleeping, &spsc_ring_buffer::has_data);
+   }
+}
+
+template<typename T>
+bool
+spsc_ring_buffer<T>::try_pop(T& value)
+{
+   const span slot = read_span(1);
+   if(slot.empty())
+   {
+      return false;
+   }
+   value = std::move(*slot.data);
+   commit_read(1);
+   return true;
+}
+
+template<typename T>
+void
+spsc_ring_buffer<T>::wait_and_pop(T& value)
+{
+   wait_for_data();
+   try_pop(value);
+}
+
+template<typename T>
+bool
+spsc_ring_buffer<T>::empty()
+{
+   return size() == 0;
+}
+
+template<typename T>
+size_t
+spsc_ring_buffer<T>::size()
+{
+   const size_t head = consumer.head.load(std::memory_order_acquire);
+   const size_t tail = producer.tail.load(std::memory_order_acquire);
+   return tail >= head ? tail - head : 0;
+}
@@ -1,68 +1,474 @@
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <memory>
 #include <mutex>
+#include <new>
 #include <condition_variable>
+#include <iterator>
+#include <type_traits>
+#include <utility>
 
+// StopToken comes from the thread pool : the overloads taking one need threadpool/src/cancel.cc linked in,
+// the rest of the queue is header-only
+#include "../threadpool/header/cancel.h"
+
+/*
+   Two-lock queue, values are stored inline in the nodes.
+   Popped nodes are recycled through a per-queue free list,
+   so once the queue has reached its working size push and pop no longer allocate.
+   push_range and pop_bulk move a batch of values with a single lock acquisition.
+   A queue constructed with a capacity is bounded : push blocks while it is full.
+   close() ends the stream : pushes fail from then on, and consumers drain what is left
+   then get an end-of-stream result instead of blocking.
+*/
 template<typename T>
 class thread_safe_queue
 {
 private:
    struct node
    {
-      std::shared_ptr<T> data;
-      std::unique_ptr<node> next;
+      // Holds a value from the push which linked the node after it, until the node is popped
+      typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+      node* next = nullptr;
+
+      T& value() { return *reinterpret_cast<T*>(&storage); }
    };
+
+   // Destroys the value of a popped node and puts the node on the free list
+   struct node_recycler
+   {
+      thread_safe_queue* queue;
+      void operator()(node* n) const { queue->release_node(n); }
+   };
+   using node_ptr = std::unique_ptr<node, node_recycler>;
+
    std::mutex head_mutex;
-   std::unique_ptr<node> head;
+   node* head;
    std::mutex tail_mutex;
    node* tail;
    std::condition_variable data_cond;
 
+   // 0 when unbounded, count is only maintained when bounded
+   const size_t capacity;
+   std::atomic<size_t> count;
+   std::atomic<int> push_waiters;
+   std::condition_variable space_cond;
+
+   // Set with both locks held
+   bool closed;
+
+   /*
+      Stack of recycled nodes.
+      Nodes are only taken off by producers holding tail_mutex, so there is a single popper
+      and a node can't be taken and pushed back while a pop is in progress (no ABA).
+      Consumers push popped nodes without holding any lock.
+   */
+   std::atomic<node*> free_list;
+
 private:
+   node* acquire_node();
+   void push_free_node(node*);
+   void push_free_chain(node* first, node* last);
+   void release_node(node*);
+   void release_capacity(size_t released = 1);
+
+   template<typename... Args>
+   void link_value(Args&&... args);
+
    node* get_tail();
-   std::unique_ptr<node> pop_head();
+   node_ptr pop_head();
    std::unique_lock<std::mutex> wait_for_data();
-   std::unique_ptr<node> wait_pop_head();
-   std::unique_ptr<node> wait_pop_head(T&);
-
-   std::unique_ptr<node> try_pop_head();
-   std::unique_ptr<node> try_pop_head(T&);
+   node_ptr wait_pop_head();
+   template<typename Clock, typename Duration>
+   node_ptr wait_pop_head_until(const std::chrono::time_point<Clock, Duration>& deadline);
+   node_ptr wait_pop_head(const arrow::StopToken& stop_token);
+   node_ptr try_pop_head();
+   node* pop_head_chain(size_t max, size_t* popped);
+   template<typename OutputIt>
+   OutputIt take_chain(node* first, size_t popped, OutputIt out);
 
 public:
    thread_safe_queue():
-      head(new node), tail(head.get())
+      thread_safe_queue(0)
+   {}
+   explicit thread_safe_queue(size_t capacity):
+      head(new node), tail(head), capacity(capacity), count(0), push_waiters(0), closed(false), free_list(nullptr)
    {}
    thread_safe_queue(const thread_safe_queue&) = delete;
    thread_safe_queue& operator=(const thread_safe_queue&) = delete;
+   ~thread_safe_queue();
 
+   // The shared_ptr API allocates the returned value, popping into a T& doesn't
    std::shared_ptr<T> try_pop();
    bool try_pop(T&);
 
+   // Return nullptr / false at end of stream : the queue is closed and drained
    std::shared_ptr<T> wait_and_pop();
-   void wait_and_pop(T&);
+   bool wait_and_pop(T&);
 
-   void push(T);
+   // Also return nullptr / false once the timeout elapses or the deadline passes
+   template<typename Rep, typename Period>
+   std::shared_ptr<T> wait_for_pop(const std::chrono::duration<Rep, Period>& timeout);
+   template<typename Rep, typename Period>
+   bool wait_for_pop(T&, const std::chrono::duration<Rep, Period>& timeout);
+   template<typename Clock, typename Duration>
+   std::shared_ptr<T> wait_until_pop(const std::chrono::time_point<Clock, Duration>& deadline);
+   template<typename Clock, typename Duration>
+   bool wait_until_pop(T&, const std::chrono::time_point<Clock, Duration>& deadline);
+
+   // Also return nullptr / false once a stop is requested, the waiter is woken by the request itself
+   // Calling them needs threadpool/src/cancel.cc (or the threadpool library) linked in
+   std::shared_ptr<T> wait_and_pop(const arrow::StopToken& stop_token);
+   bool wait_and_pop(T&, const arrow::StopToken& stop_token);
+
+   // Block while the queue is full, return false if it is closed
+   bool push(T);
+
+   // Construct the value in place, under the tail lock
+   template<typename... Args>
+   bool emplace(Args&&... args);
+
+   // Return false if the queue is full or closed, new_value is then left untouched
+   bool try_push(T&& new_value);
+
+   /*
+      Push the values of [first, last) in order, under a single tail lock per batch.
+      A bounded queue takes as many values per batch as it has room for, blocking in between.
+      Return the number of values pushed, less than the range only if the queue was closed.
+   */
+   template<typename InputIt>
+   size_t push_range(InputIt first, InputIt last);
+
+   // Move up to max values to out under a single head lock, return the number of values popped
+   template<typename OutputIt>
+   size_t pop_bulk(OutputIt out, size_t max);
+
+   // Same as pop_bulk but wait for at least one value, 0 means end of stream
+   template<typename OutputIt>
+   size_t wait_pop_bulk(OutputIt out, size_t max);
+
+   // Wake every waiter, pending values can still be popped
+   void close();
+   bool is_closed();
 
    bool empty();
 };
 
 template<typename T>
-void 
+thread_safe_queue<T>::~thread_safe_queue()
+{
+   // Every node before the tail holds a value
+   while(head != tail)
+   {
+      node* const next = head->next;
+      head->value().~T();
+      delete head;
+      head = next;
+   }
+   delete tail;
+
+   node* n = free_list.load(std::memory_order_relaxed);
+   while(n != nullptr)
+   {
+      node* const next = n->next;
+      delete n;
+      n = next;
+   }
+}
+
+template<typename T>
+typename thread_safe_queue<T>::node*
+thread_safe_queue<T>::acquire_node()
+{
+   node* n = free_list.load(std::memory_order_acquire);
+   while(n != nullptr &&
+         !free_list.compare_exchange_weak(n, n->next, std::memory_order_acquire, std::memory_order_acquire))
+   {}
+   if(n == nullptr)
+   {
+      return new node;
+   }
+   n->next = nullptr;
+   return n;
+}
+
+template<typename T>
+void
+thread_safe_queue<T>::push_free_node(node* n)
+{
+   push_free_chain(n, n);
+}
+
+// Push the nodes linked from first to last at once
+template<typename T>
+void
+thread_safe_queue<T>::push_free_chain(node* first, node* last)
+{
+   last->next = free_list.load(std::memory_order_relaxed);
+   while(!free_list.compare_exchange_weak(last->next, first, std::memory_order_release, std::memory_order_relaxed))
+   {}
+}
+
+template<typename T>
+void
+thread_safe_queue<T>::release_node(node* n)
+{
+   n->value().~T();
+   push_free_node(n);
+}
+
+template<typename T>
+void
+thread_safe_queue<T>::release_capacity(size_t released)
+{
+   // Pairs with the check in emplace(), either the producer sees the new count or we see the waiter
+   count.fetch_sub(released);
+   if(push_waiters.load() != 0)
+   {
+      std::lock_guard<std::mutex> tail_lock(tail_mutex);
+      if(released == 1)
+      {
+         space_cond.notify_one();
+      }
+      else
+      {
+         space_cond.notify_all();
+      }
+   }
+}
+
+// Called with the tail lock held
+template<typename T>
+template<typename... Args>
+void
+thread_safe_queue<T>::link_value(Args&&... args)
+{
+   node* const new_tail = acquire_node();
+   try
+   {
+      ::new (&tail->storage) T(std::forward<Args>(args)...);
+   }
+   catch(...)
+   {
+      push_free_node(new_tail);
+      throw;
+   }
+   tail->next = new_tail;
+   tail = new_tail;
+   if(capacity != 0)
+   {
+      count.fetch_add(1);
+   }
+}
+
+template<typename T>
+template<typename... Args>
+bool
+thread_safe_queue<T>::emplace(Args&&... args)
+{
+   {
+      std::unique_lock<std::mutex> tail_lock(tail_mutex);
+      if(capacity != 0 && count.load() >= capacity && !closed)
+      {
+         push_waiters.fetch_add(1);
+         space_cond.wait(tail_lock, [&]{return closed || count.load() < capacity;});
+         push_waiters.fetch_sub(1);
+      }
+      if(closed)
+      {
+         return false;
+      }
+      link_value(std::forward<Args>(args)...);
+   }
+   data_cond.notify_one();
+   return true;
+}
+
+template<typename T>
+bool
 thread_safe_queue<T>::push(T new_value)
 {
-   std::shared_ptr<T> new_data(std::make_shared<T>(std::move(new_value)));
-   std::unique_ptr<node> p(new node);
+   return emplace(std::move(new_value));
+}
+
+template<typename T>
+bool
+thread_safe_queue<T>::try_push(T&& new_value)
+{
    {
       std::lock_guard<std::mutex> tail_lock(tail_mutex);
-      tail->data = new_data;
-      node* const new_tail = p.get();
-      tail->next = std::move(p);
-      tail = new_tail;
+      if(closed || (capacity != 0 && count.load() >= capacity))
+      {
+         return false;
+      }
+      link_value(std::move(new_value));
    }
    data_cond.notify_one();
+   return true;
+}
+
+template<typename T>
+template<typename InputIt>
+size_t
+thread_safe_queue<T>::push_range(InputIt first, InputIt last)
+{
+   size_t pushed = 0;
+   while(first != last)
+   {
+      size_t batch = 0;
+      {
+         std::unique_lock<std::mutex> tail_lock(tail_mutex);
+         if(capacity != 0 && count.load() >= capacity && !closed)
+         {
+            push_waiters.fetch_add(1);
+            space_cond.wait(tail_lock, [&]{return closed || count.load() < capacity;});
+            push_waiters.fetch_sub(1);
+         }
+         if(closed)
+         {
+            break;
+         }
+         const size_t room = capacity != 0 ? capacity - count.load() : static_cast<size_t>(-1);
+         try
+         {
+            for(; first != last && batch < room; ++first, ++batch)
+            {
+               link_value(*first);
+            }
+         }
+         catch(...)
+         {
+            tail_lock.unlock();
+            data_cond.notify_all();
+            throw;
+         }
+      }
+      pushed += batch;
+      if(batch == 1)
+      {
+         data_cond.notify_one();
+      }
+      else
+      {
+         data_cond.notify_all();
+      }
+   }
+   return pushed;
+}
+
+// Called with the head lock held, detach up to max nodes holding a value
+template<typename T>
+typename thread_safe_queue<T>::node*
+thread_safe_queue<T>::pop_head_chain(size_t max, size_t* popped)
+{
+   node* const first = head;
+   node* const current_tail = get_tail();
+   size_t n = 0;
+   while(n < max && head != current_tail)
+   {
+      head = head->next;
+      ++n;
+   }
+   if(capacity != 0 && n != 0)
+   {
+      release_capacity(n);
+   }
+   *popped = n;
+   return first;
 }
 
+// Move the values of a detached chain to out, then recycle its nodes
 template<typename T>
-typename thread_safe_queue<T>::node* 
+template<typename OutputIt>
+OutputIt
+thread_safe_queue<T>::take_chain(node* first, size_t popped, OutputIt out)
+{
+   node* n = first;
+   node* last = first;
+   try
+   {
+      for(; popped != 0; --popped)
+      {
+         *out = std::move(n->value());
+         ++out;
+         n->value().~T();
+         last = n;
+         n = n->next;
+      }
+   }
+   catch(...)
+   {
+      // The values not handed out yet are dropped
+      for(; popped != 0; --popped)
+      {
+         n->value().~T();
+         last = n;
+         n = n->next;
+      }
+      push_free_chain(first, last);
+      throw;
+   }
+   if(n != first)
+   {
+      push_free_chain(first, last);
+   }
+   return out;
+}
+
+template<typename T>
+template<typename OutputIt>
+size_t
+thread_safe_queue<T>::pop_bulk(OutputIt out, size_t max)
+{
+   size_t popped = 0;
+   node* first = nullptr;
+   {
+      std::lock_guard<std::mutex> head_lock(head_mutex);
+      first = pop_head_chain(max, &popped);
+   }
+   take_chain(first, popped, out);
+   return popped;
+}
+
+template<typename T>
+template<typename OutputIt>
+size_t
+thread_safe_queue<T>::wait_pop_bulk(OutputIt out, size_t max)
+{
+   size_t popped = 0;
+   node* first = nullptr;
+   {
+      std::unique_lock<std::mutex> head_lock(wait_for_data());
+      first = pop_head_chain(max, &popped);
+   }
+   take_chain(first, popped, out);
+   return popped;
+}
+
+template<typename T>
+void
+thread_safe_queue<T>::close()
+{
+   {
+      std::lock_guard<std::mutex> head_lock(head_mutex);
+      std::lock_guard<std::mutex> tail_lock(tail_mutex);
+      closed = true;
+   }
+   data_cond.notify_all();
+   space_cond.notify_all();
+}
+
+template<typename T>
+bool
+thread_safe_queue<T>::is_closed()
+{
+   std::lock_guard<std::mutex> tail_lock(tail_mutex);
+   return closed;
+}
+
+template<typename T>
+typename thread_safe_queue<T>::node*
 thread_safe_queue<T>::get_tail()
 {
    std::lock_guard<std::mutex> tail_lock(tail_mutex);
@@ -70,77 +476,167 @@ thread_safe_queue<T>::get_tail()
 }
 
 template<typename T>
-std::unique_ptr<typename thread_safe_queue<T>::node> 
+typename thread_safe_queue<T>::node_ptr
 thread_safe_queue<T>::pop_head()
 {
-   std::unique_ptr<node> old_head = std::move(head);
-   head = std::move(old_head->next);
-   return old_head;
+   node* const old_head = head;
+   head = old_head->next;
+   if(capacity != 0)
+   {
+      release_capacity();
+   }
+   return node_ptr(old_head, node_recycler{this});
 }
 
 template<typename T>
-std::unique_lock<std::mutex> 
+std::unique_lock<std::mutex>
 thread_safe_queue<T>::wait_for_data()
 {
    std::unique_lock<std::mutex> head_lock(head_mutex);
-   data_cond.wait(head_lock, [&]{return head.get() != get_tail();});
+   data_cond.wait(head_lock, [&]{return head != get_tail() || closed;});
    return std::move(head_lock);
 }
 
 template<typename T>
-std::unique_ptr<typename thread_safe_queue<T>::node> 
+typename thread_safe_queue<T>::node_ptr
 thread_safe_queue<T>::wait_pop_head()
 {
    std::unique_lock<std::mutex> head_lock(wait_for_data());
+   if(head == get_tail())
+   {
+      return node_ptr(nullptr, node_recycler{this});
+   }
    return pop_head();
 }
 
 template<typename T>
-std::unique_ptr<typename thread_safe_queue<T>::node>
-thread_safe_queue<T>::wait_pop_head(T& value)
+std::shared_ptr<T>
+thread_safe_queue<T>::wait_and_pop()
 {
-   std::unique_lock<std::mutex> head_lock(wait_for_data());
-   value = std::move(*head->data);
+   // The value is moved out of the node after the head lock is released
+   node_ptr const old_head = wait_pop_head();
+   return old_head ? std::make_shared<T>(std::move(old_head->value())) : std::shared_ptr<T>();
+}
+
+template<typename T>
+bool
+thread_safe_queue<T>::wait_and_pop(T& value)
+{
+   node_ptr const old_head = wait_pop_head();
+   if(!old_head)
+   {
+      return false;
+   }
+   value = std::move(old_head->value());
+   return true;
+}
+
+template<typename T>
+template<typename Clock, typename Duration>
+typename thread_safe_queue<T>::node_ptr
+thread_safe_queue<T>::wait_pop_head_until(const std::chrono::time_point<Clock, Duration>& deadline)
+{
+   std::unique_lock<std::mutex> head_lock(head_mutex);
+   data_cond.wait_until(head_lock, deadline, [&]{return head != get_tail() || closed;});
+   if(head == get_tail())
+   {
+      return node_ptr(nullptr, node_recycler{this});
+   }
    return pop_head();
 }
 
 template<typename T>
+typename thread_safe_queue<T>::node_ptr
+thread_safe_queue<T>::wait_pop_head(const arrow::StopToken& stop_token)
+{
+   // Taking the head lock before notifying makes sure a waiter can't miss the wake-up between its check and its wait
+   arrow::StopCallbackRegistration registration(stop_token, [this]
+   {
+      {
+         std::lock_guard<std::mutex> head_lock(head_mutex);
+      }
+      data_cond.notify_all();
+   });
+
+   // Released before the registration is destroyed, as the stop callback takes the head lock
+   std::unique_lock<std::mutex> head_lock(head_mutex);
+   data_cond.wait(head_lock, [&]{return head != get_tail() || closed || stop_token.IsStopRequested();});
+   if(head == get_tail() || stop_token.IsStopRequested())
+   {
+      return node_ptr(nullptr, node_recycler{this});
+   }
+   return pop_head();
+}
+
+template<typename T>
+template<typename Rep, typename Period>
 std::shared_ptr<T>
-thread_safe_queue<T>::wait_and_pop()
+thread_safe_queue<T>::wait_for_pop(const std::chrono::duration<Rep, Period>& timeout)
 {
-   std::unique_ptr<node> const old_head = wait_pop_head();
-   return old_head->data;
+   return wait_until_pop(std::chrono::steady_clock::now() + timeout);
 }
 
 template<typename T>
-void
-thread_safe_queue<T>::wait_and_pop(T& value)
+template<typename Rep, typename Period>
+bool
+thread_safe_queue<T>::wait_for_pop(T& value, const std::chrono::duration<Rep, Period>& timeout)
 {
-   std::unique_ptr<node> const old_head = wait_pop_head(value);
+   return wait_until_pop(value, std::chrono::steady_clock::now() + timeout);
 }
 
 template<typename T>
-std::unique_ptr<typename thread_safe_queue<T>::node>
-thread_safe_queue<T>::try_pop_head()
+template<typename Clock, typename Duration>
+std::shared_ptr<T>
+thread_safe_queue<T>::wait_until_pop(const std::chrono::time_point<Clock, Duration>& deadline)
 {
-   std::lock_guard<std::mutex> head_lock(head_mutex);
-   if(head.get() == get_tail())
+   node_ptr const old_head = wait_pop_head_until(deadline);
+   return old_head ? std::make_shared<T>(std::move(old_head->value())) : std::shared_ptr<T>();
+}
+
+template<typename T>
+template<typename Clock, typename Duration>
+bool
+thread_safe_queue<T>::wait_until_pop(T& value, const std::chrono::time_point<Clock, Duration>& deadline)
+{
+   node_ptr const old_head = wait_pop_head_until(deadline);
+   if(!old_head)
    {
-      return std::unique_ptr<node>();
+      return false;
    }
-   return pop_head();
+   value = std::move(old_head->value());
+   return true;
+}
+
+template<typename T>
+std::shared_ptr<T>
+thread_safe_queue<T>::wait_and_pop(const arrow::StopToken& stop_token)
+{
+   node_ptr const old_head = wait_pop_head(stop_token);
+   return old_head ? std::make_shared<T>(std::move(old_head->value())) : std::shared_ptr<T>();
+}
+
+template<typename T>
+bool
+thread_safe_queue<T>::wait_and_pop(T& value, const arrow::StopToken& stop_token)
+{
+   node_ptr const old_head = wait_pop_head(stop_token);
+   if(!old_head)
+   {
+      return false;
+   }
+   value = std::move(old_head->value());
+   return true;
 }
 
 template<typename T>
-std::unique_ptr<typename thread_safe_queue<T>::node>
-thread_safe_queue<T>::try_pop_head(T& value)
+typename thread_safe_queue<T>::node_ptr
+thread_safe_queue<T>::try_pop_head()
 {
    std::lock_guard<std::mutex> head_lock(head_mutex);
-   if(head.get() == get_tail())
+   if(head == get_tail())
    {
-      return std::unique_ptr<node>();
+      return node_ptr(nullptr, node_recycler{this});
    }
-   value = std::move(*head->data);
    return pop_head();
 }
 
@@ -148,16 +644,21 @@ template<typename T>
 std::shared_ptr<T>
 thread_safe_queue<T>::try_pop()
 {
-   std::unique_ptr<node> old_head = try_pop_head();
-   return old_head ? old_head->data : std::shared_ptr<T>();
+   node_ptr const old_head = try_pop_head();
+   return old_head ? std::make_shared<T>(std::move(old_head->value())) : std::shared_ptr<T>();
 }
 
 template<typename T>
 bool
 thread_safe_queue<T>::try_pop(T& value)
 {
-   std::unique_ptr<node> const old_head = try_pop_head(value);
-   return old_head != nullptr;
+   node_ptr const old_head = try_pop_head();
+   if(!old_head)
+   {
+      return false;
+   }
+   value = std::move(old_head->value());
+   return true;
 }
 
 template<typename T>
@@ -165,5 +666,5 @@ bool
 thread_safe_queue<T>::empty()
 {
   std::lock_guard<std::mutex> head_lock(head_mutex);
-  return (head.get() == get_tail());
+  return (head == get_tail());
 }
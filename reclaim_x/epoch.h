@@ -0,0 +1,384 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/*
+   Epoch-based memory reclamation (EBR) for read-mostly lock-free containers.
+
+   A thread reading shared nodes does it inside an epoch_guard : the guard announces the global epoch the thread
+   observed, a node removed from a container is handed to epoch_retire, which stamps it with the global epoch.
+   The global epoch only moves forward once every thread inside a guard announced the current one,
+   so once it got two epochs past a stamp no reader can still hold the node and it is freed.
+   Unlike hazard pointers the cost is paid once per critical section, not once per node dereferenced.
+
+   Threads which run short units of work in a loop, none of which blocks, can instead go online :
+   they are then considered inside a critical section all the time and announce the current epoch at their
+   quiescent points, between two units of work, with epoch_quiescent (one load and a compare while the epoch
+   doesn't move). A guard taken on an online thread costs nothing more than a counter increment.
+   An online thread must go offline before blocking, otherwise it holds every retired node back.
+
+   ThreadPool workers stay offline, as their tasks may block anywhere : a task takes guards like any other thread,
+   and a task blocked outside a guard holds nothing back. Workers still call epoch_quiescent between two tasks,
+   which on an offline thread helps the epoch along and frees the nodes their tasks retired.
+
+   Usage in a container :
+
+      epoch_guard guard;                       // nodes read from here on stay valid until guard is destroyed
+      node* old_head = head.load();
+      if(old_head && head.compare_exchange_strong(old_head, old_head->next))
+      {
+         epoch_retire(old_head);               // deleted once every reader of old_head left its critical section
+      }
+*/
+
+namespace epoch_detail
+{
+
+struct alignas(64) epoch_record
+{
+   // 0 while the thread is outside any critical section, (epoch << 1) | 1 while inside
+   std::atomic<uint64_t> state{0};
+   std::atomic<bool> active{false};
+   epoch_record* next = nullptr;
+};
+
+struct retired_node
+{
+   void* pointer;
+   void (*deleter)(void*);
+};
+
+// Retired nodes of one epoch
+struct limbo_bag
+{
+   uint64_t epoch = 0;
+   std::vector<retired_node> nodes;
+
+   void free_all()
+   {
+      for(const retired_node& node : nodes)
+      {
+         node.deleter(node.pointer);
+      }
+      nodes.clear();
+   }
+};
+
+// Retired nodes left behind by exited threads
+struct orphan_batch
+{
+   uint64_t epoch;
+   std::vector<retired_node> nodes;
+   orphan_batch* next = nullptr;
+};
+
+struct alignas(64) global_counter
+{
+   std::atomic<uint64_t> epoch{1};
+};
+
+// Records are never freed, so threads advancing the epoch can walk the list without protection
+inline global_counter global;
+inline std::atomic<epoch_record*> record_list{nullptr};
+inline std::atomic<orphan_batch*> orphans{nullptr};
+
+// Retirements between two attempts at advancing the epoch
+constexpr size_t collect_threshold = 128;
+// Quiescent points between two attempts, for a thread with retired nodes waiting
+constexpr unsigned quiescent_advance_period = 64;
+
+inline epoch_record* acquire_record()
+{
+   for(epoch_record* record = record_list.load(std::memory_order_acquire); record != nullptr; record = record->next)
+   {
+      bool expected = false;
+      if(!record->active.load(std::memory_order_relaxed) &&
+         record->active.compare_exchange_strong(expected, true, std::memory_order_acquire))
+      {
+         return record;
+      }
+   }
+
+   epoch_record* const record = new epoch_record;
+   record->active.store(true, std::memory_order_relaxed);
+   record->next = record_list.load(std::memory_order_relaxed);
+   while(!record_list.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed))
+   {}
+   return record;
+}
+
+/*
+   Move the global epoch forward if every thread inside a critical section announced the current one.
+*/
+inline void try_advance()
+{
+   uint64_t epoch = global.epoch.load(std::memory_order_relaxed);
+
+   // Pairs with the fence in thread_state::announce : a thread which announced an older epoch is seen here
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+
+   for(epoch_record* record = record_list.load(std::memory_order_acquire); record != nullptr; record = record->next)
+   {
+      const uint64_t state = record->state.load(std::memory_order_acquire);
+      if((state & 1) != 0 && (state >> 1) != epoch)
+      {
+         return;
+      }
+   }
+   global.epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel, std::memory_order_relaxed);
+}
+
+/*
+   Per-thread state : the epoch record, the guard nesting depth and one limbo bag per epoch still in flight.
+   A bag stamped e is freed once the global epoch reaches e + 2, so three bags are enough.
+*/
+class thread_state
+{
+public:
+   epoch_record* record = nullptr;
+   unsigned depth = 0;
+   bool online = false;
+   limbo_bag bags[3];
+   size_t retired_since_collect = 0;
+   unsigned quiescent_calls = 0;
+
+   ~thread_state()
+   {
+      if(record == nullptr)
+      {
+         return;
+      }
+      record->state.store(0, std::memory_order_release);
+      try_advance();
+      collect();
+
+      for(limbo_bag& bag : bags)
+      {
+         if(!bag.nodes.empty())
+         {
+            orphan_batch* const batch = new orphan_batch;
+            batch->epoch = bag.epoch;
+            batch->nodes.swap(bag.nodes);
+            batch->next = orphans.load(std::memory_order_relaxed);
+            while(!orphans.compare_exchange_weak(batch->next, batch, std::memory_order_release, std::memory_order_relaxed))
+            {}
+         }
+      }
+      record->active.store(false, std::memory_order_release);
+   }
+
+   epoch_record* get_record()
+   {
+      if(record == nullptr)
+      {
+         record = acquire_record();
+      }
+      return record;
+   }
+
+   // Enter a critical section at the current epoch
+   void announce()
+   {
+      const uint64_t epoch = global.epoch.load(std::memory_order_relaxed);
+      // Release : on an online thread this also ends the previous critical section, whose reads must stay before it
+      get_record()->state.store((epoch << 1) | 1, std::memory_order_release);
+      // The announcement must be visible before the first node is read
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+   }
+
+   void leave()
+   {
+      record->state.store(0, std::memory_order_release);
+   }
+
+   // The bag nodes stamped epoch go to, emptied first if it still holds an older epoch
+   limbo_bag& bag_for(uint64_t epoch)
+   {
+      limbo_bag& bag = bags[epoch % 3];
+      if(bag.epoch != epoch)
+      {
+         // Stamped at most epoch - 3 and epoch is not ahead of the global epoch
+         bag.free_all();
+         bag.epoch = epoch;
+      }
+      return bag;
+   }
+
+   bool has_retired() const
+   {
+      return !bags[0].nodes.empty() || !bags[1].nodes.empty() || !bags[2].nodes.empty();
+   }
+
+   // Free the bags two epochs behind the global one and adopt what exited threads left behind
+   void collect()
+   {
+      retired_since_collect = 0;
+      const uint64_t epoch = global.epoch.load(std::memory_order_acquire);
+      for(limbo_bag& bag : bags)
+      {
+         if(bag.epoch + 2 <= epoch)
+         {
+            bag.free_all();
+         }
+      }
+
+      for(orphan_batch* batch = orphans.exchange(nullptr, std::memory_order_acquire); batch != nullptr; )
+      {
+         if(batch->epoch + 2 <= epoch)
+         {
+            limbo_bag expired;
+            expired.nodes.swap(batch->nodes);
+            expired.free_all();
+         }
+         else
+         {
+            // Stamping them with a later epoch only delays them
+            limbo_bag& bag = bag_for(epoch);
+            bag.nodes.insert(bag.nodes.end(), batch->nodes.begin(), batch->nodes.end());
+         }
+         orphan_batch* const next = batch->next;
+         delete batch;
+         batch = next;
+      }
+   }
+};
+
+inline thread_state& local_state()
+{
+   static thread_local thread_state state;
+   return state;
+}
+
+}  // namespace epoch_detail
+
+/*
+   Critical section of the calling thread, the nodes it reads are not freed before it is destroyed.
+   Guards nest, only the outermost one announces the epoch.
+*/
+class epoch_guard
+{
+public:
+   epoch_guard();
+   ~epoch_guard();
+   epoch_guard(const epoch_guard&) = delete;
+   epoch_guard& operator=(const epoch_guard&) = delete;
+};
+
+inline
+epoch_guard::epoch_guard()
+{
+   epoch_detail::thread_state& state = epoch_detail::local_state();
+   if(state.depth++ == 0 && !state.online)
+   {
+      state.announce();
+   }
+}
+
+inline
+epoch_guard::~epoch_guard()
+{
+   epoch_detail::thread_state& state = epoch_detail::local_state();
+   if(--state.depth == 0 && !state.online)
+   {
+      state.leave();
+   }
+}
+
+/*
+   Hand over a node unlinked from its container, deleter runs once no critical section can still see it.
+*/
+template<typename T, typename Deleter = std::default_delete<T>>
+void epoch_retire(T* pointer, Deleter deleter = Deleter())
+{
+   static_assert(std::is_empty<Deleter>::value, "the deleter is rebuilt at reclamation time, it must be stateless");
+   (void)deleter;
+
+   epoch_detail::thread_state& state = epoch_detail::local_state();
+   // The node was unlinked before the epoch is read, a reader which could still reach it announced at most this one
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+   const uint64_t epoch = epoch_detail::global.epoch.load(std::memory_order_relaxed);
+   state.bag_for(epoch).nodes.push_back({pointer, [](void* p) { Deleter()(static_cast<T*>(p)); }});
+   if(++state.retired_since_collect >= epoch_detail::collect_threshold)
+   {
+      epoch_detail::try_advance();
+      state.collect();
+   }
+}
+
+/*
+   The calling thread enters a critical section lasting until epoch_offline, interrupted by its calls to epoch_quiescent.
+*/
+inline void epoch_online()
+{
+   epoch_detail::thread_state& state = epoch_detail::local_state();
+   if(!state.online)
+   {
+      state.online = true;
+      if(state.depth == 0)
+      {
+         state.announce();
+      }
+   }
+}
+
+inline void epoch_offline()
+{
+   epoch_detail::thread_state& state = epoch_detail::local_state();
+   if(state.online)
+   {
+      state.online = false;
+      if(state.depth == 0)
+      {
+         state.leave();
+      }
+   }
+}
+
+/*
+   Called by a thread holding no reference to shared nodes, outside any guard.
+   An online thread catches up with the global epoch, and frees its retired nodes once the epoch moved far enough.
+   An offline thread with retired nodes waiting tries to move the epoch on and frees them every few calls.
+*/
+inline void epoch_quiescent()
+{
+   epoch_detail::thread_state& state = epoch_detail::local_state();
+   if(state.depth != 0)
+   {
+      return;
+   }
+   if(!state.online)
+   {
+      if(state.has_retired() && ++state.quiescent_calls % epoch_detail::quiescent_advance_period == 0)
+      {
+         epoch_detail::try_advance();
+         state.collect();
+      }
+      return;
+   }
+   const uint64_t epoch = epoch_detail::global.epoch.load(std::memory_order_relaxed);
+   if(state.record->state.load(std::memory_order_relaxed) != ((epoch << 1) | 1))
+   {
+      state.announce();
+      if(state.has_retired())
+      {
+         state.collect();
+      }
+   }
+   else if(state.has_retired() && ++state.quiescent_calls % epoch_detail::quiescent_advance_period == 0)
+   {
+      // Nobody else may be retiring, so nobody else moves the epoch on
+      epoch_detail::try_advance();
+   }
+}
+
+// Try to move the epoch on and free every retired node of the calling thread nobody can see anymore
+inline void epoch_collect()
+{
+   epoch_detail::try_advance();
+   epoch_detail::local_state().collect();
+}
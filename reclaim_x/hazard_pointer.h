@@ -0,0 +1,297 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/*
+   Hazard-pointer memory reclamation for lock-free containers.
+
+   A thread about to dereference a shared node first publishes its address in one of its hazard slots
+   (hazard_pointer::protect), a node removed from a container is handed to hazard_retire instead of being deleted.
+   Retired nodes wait on a per-thread list, and once the list reaches a threshold proportional to the number of slots,
+   one scan collects every published hazard pointer and frees the retired nodes nobody protects :
+   the cost of a scan is amortized over as many retirements as there are slots.
+
+   Every thread gets a record of hazard_slots_per_thread slots on its first use, records are recycled when threads exit.
+   A thread exiting with nodes still protected by others hands them over to the next thread which scans.
+
+   Usage in a container :
+
+      hazard_pointer hp;
+      node* old_head = hp.protect(head);       // safe to dereference until hp is reset or destroyed
+      if(old_head && head.compare_exchange_strong(old_head, old_head->next))
+      {
+         hp.reset_protection();
+         hazard_retire(old_head);              // deleted once no hazard pointer refers to it
+      }
+*/
+
+constexpr size_t hazard_slots_per_thread = 4;
+
+namespace hazard_detail
+{
+
+struct hazard_record
+{
+   std::atomic<const void*> slots[hazard_slots_per_thread];
+   std::atomic<bool> active{false};
+   hazard_record* next = nullptr;
+
+   hazard_record()
+   {
+      for(auto& slot : slots)
+      {
+         slot.store(nullptr, std::memory_order_relaxed);
+      }
+   }
+};
+
+struct retired_node
+{
+   void* pointer;
+   void (*deleter)(void*);
+};
+
+// Retired nodes left behind by exited threads
+struct orphan_batch
+{
+   std::vector<retired_node> nodes;
+   orphan_batch* next = nullptr;
+};
+
+// Records are never freed, so scanners can walk the list without protection
+inline std::atomic<hazard_record*> record_list{nullptr};
+inline std::atomic<size_t> record_count{0};
+inline std::atomic<orphan_batch*> orphans{nullptr};
+
+inline hazard_record* acquire_record()
+{
+   for(hazard_record* record = record_list.load(std::memory_order_acquire); record != nullptr; record = record->next)
+   {
+      bool expected = false;
+      if(!record->active.load(std::memory_order_relaxed) &&
+         record->active.compare_exchange_strong(expected, true, std::memory_order_acquire))
+      {
+         return record;
+      }
+   }
+
+   hazard_record* const record = new hazard_record;
+   record->active.store(true, std::memory_order_relaxed);
+   record->next = record_list.load(std::memory_order_relaxed);
+   while(!record_list.compare_exchange_weak(record->next, record, std::memory_order_release, std::memory_order_relaxed))
+   {}
+   record_count.fetch_add(1, std::memory_order_relaxed);
+   return record;
+}
+
+/*
+   Free the retired nodes no hazard pointer refers to, keep the others in retired.
+*/
+inline void scan(std::vector<retired_node>& retired)
+{
+   // Adopt what exited threads left behind
+   for(orphan_batch* batch = orphans.exchange(nullptr, std::memory_order_acquire); batch != nullptr; )
+   {
+      retired.insert(retired.end(), batch->nodes.begin(), batch->nodes.end());
+      orphan_batch* const next = batch->next;
+      delete batch;
+      batch = next;
+   }
+
+   // Pairs with the fence in hazard_pointer::protect : a node retired before this point was unlinked before,
+   // so a protection published after it would have failed its validation
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+
+   std::vector<const void*> hazards;
+   hazards.reserve(record_count.load(std::memory_order_relaxed) * hazard_slots_per_thread);
+   for(hazard_record* record = record_list.load(std::memory_order_acquire); record != nullptr; record = record->next)
+   {
+      for(auto& slot : record->slots)
+      {
+         if(const void* pointer = slot.load(std::memory_order_acquire))
+         {
+            hazards.push_back(pointer);
+         }
+      }
+   }
+   std::sort(hazards.begin(), hazards.end());
+
+   std::vector<retired_node> kept;
+   for(const retired_node& node : retired)
+   {
+      if(std::binary_search(hazards.begin(), hazards.end(), static_cast<const void*>(node.pointer)))
+      {
+         kept.push_back(node);
+      }
+      else
+      {
+         node.deleter(node.pointer);
+      }
+   }
+   retired.swap(kept);
+}
+
+/*
+   Per-thread state : the hazard record, which of its slots are taken and the retired list.
+*/
+class thread_state
+{
+public:
+   hazard_record* record = nullptr;
+   unsigned used_slots = 0;
+   std::vector<retired_node> retired;
+
+   ~thread_state()
+   {
+      if(!retired.empty())
+      {
+         scan(retired);
+      }
+      if(!retired.empty())
+      {
+         orphan_batch* const batch = new orphan_batch;
+         batch->nodes.swap(retired);
+         batch->next = orphans.load(std::memory_order_relaxed);
+         while(!orphans.compare_exchange_weak(batch->next, batch, std::memory_order_release, std::memory_order_relaxed))
+         {}
+      }
+      if(record != nullptr)
+      {
+         record->active.store(false, std::memory_order_release);
+      }
+   }
+
+   hazard_record* get_record()
+   {
+      if(record == nullptr)
+      {
+         record = acquire_record();
+      }
+      return record;
+   }
+
+   // Scan once the list outgrows the number of hazard pointers, so that at least half the nodes are freed
+   size_t scan_threshold() const
+   {
+      return 2 * record_count.load(std::memory_order_relaxed) * hazard_slots_per_thread + 64;
+   }
+};
+
+inline thread_state& local_state()
+{
+   static thread_local thread_state state;
+   return state;
+}
+
+}  // namespace hazard_detail
+
+/*
+   One hazard slot of the calling thread, released on destruction.
+   A thread can hold up to hazard_slots_per_thread of them at once.
+*/
+class hazard_pointer
+{
+private:
+   std::atomic<const void*>* slot;
+   unsigned index;
+
+public:
+   hazard_pointer();
+   ~hazard_pointer();
+   hazard_pointer(const hazard_pointer&) = delete;
+   hazard_pointer& operator=(const hazard_pointer&) = delete;
+
+   // Load src and publish it until it is stable, the returned node can then be dereferenced safely
+   template<typename T>
+   T* protect(const std::atomic<T*>& src);
+
+   // Publish a pointer already known to be reachable, the caller validates it afterwards
+   void set(const void* pointer);
+
+   void reset_protection();
+};
+
+inline
+hazard_pointer::hazard_pointer()
+{
+   hazard_detail::thread_state& state = hazard_detail::local_state();
+   hazard_detail::hazard_record* const record = state.get_record();
+   index = 0;
+   while(index < hazard_slots_per_thread && (state.used_slots & (1u << index)) != 0)
+   {
+      ++index;
+   }
+   if(index == hazard_slots_per_thread)
+   {
+      std::terminate();
+   }
+   state.used_slots |= 1u << index;
+   slot = &record->slots[index];
+}
+
+inline
+hazard_pointer::~hazard_pointer()
+{
+   slot->store(nullptr, std::memory_order_release);
+   hazard_detail::local_state().used_slots &= ~(1u << index);
+}
+
+template<typename T>
+T*
+hazard_pointer::protect(const std::atomic<T*>& src)
+{
+   T* pointer = src.load(std::memory_order_relaxed);
+   for(;;)
+   {
+      slot->store(pointer, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      T* const current = src.load(std::memory_order_acquire);
+      if(current == pointer)
+      {
+         return pointer;
+      }
+      pointer = current;
+   }
+}
+
+inline void
+hazard_pointer::set(const void* pointer)
+{
+   slot->store(pointer, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+inline void
+hazard_pointer::reset_protection()
+{
+   slot->store(nullptr, std::memory_order_release);
+}
+
+/*
+   Hand over a node unlinked from its container, deleter runs once no hazard pointer refers to it.
+*/
+template<typename T, typename Deleter = std::default_delete<T>>
+void hazard_retire(T* pointer, Deleter deleter = Deleter())
+{
+   static_assert(std::is_empty<Deleter>::value, "the deleter is rebuilt at reclamation time, it must be stateless");
+   (void)deleter;
+
+   hazard_detail::thread_state& state = hazard_detail::local_state();
+   state.retired.push_back({pointer, [](void* p) { Deleter()(static_cast<T*>(p)); }});
+   if(state.retired.size() >= state.scan_threshold())
+   {
+      hazard_detail::scan(state.retired);
+   }
+}
+
+// Free every retired node of the calling thread that is no longer protected
+inline void hazard_scan()
+{
+   hazard_detail::scan(hazard_detail::local_state().retired);
+}
@@ -0,0 +1,108 @@
+#include <memory>
+#include <atomic>
+#include <utility>
+
+#include "../reclaim_x/epoch.h"
+
+/*
+    用基于epoch的回收（EBR）管理节点的无锁栈，接口与lock_free_stack、hazard_pointer_stack相同。
+    hazard_pointer_stack每读一个节点都要发布一次风险指针（一次store加一次fence），
+    这里整个pop只进入一次epoch临界区：线程已经处于online状态时（见epoch_online），临界区只是一次计数器加一；
+    其他线程进入临界区也只有一次store加一次fence，之后读多少个节点都不再有额外开销。
+    临界区内读到的节点不会被释放，也就不会有ABA问题。数据直接存放在节点里，push只分配一次节点。
+*/
+template<typename T>
+class epoch_stack
+{
+private:
+    struct node
+    {
+        T data;
+        node* next;
+
+        template<typename... Args>
+        explicit node(Args&&... args) : data(std::forward<Args>(args)...), next(nullptr) {}
+    };
+
+    std::atomic<node*> head{nullptr};
+
+    node* pop_node(); //弹出头节点，返回的节点已经从栈上摘下，由调用者取走数据后retire
+
+public:
+    epoch_stack() = default;
+    epoch_stack(const epoch_stack&) = delete;
+    epoch_stack& operator=(const epoch_stack&) = delete;
+    ~epoch_stack();
+
+    void push(const T& data);
+    void push(T&& data);
+
+    std::shared_ptr<T> pop();
+    bool pop(T& value);
+};
+
+
+/*-------------------The following code is the implementation-----------------*/
+
+
+template<typename T>
+epoch_stack<T>::~epoch_stack()
+{
+    //析构时不会再有其他线程访问，直接释放
+    node* current = head.load(std::memory_order_relaxed);
+    while (current) {
+        node* const next = current->next;
+        delete current;
+        current = next;
+    }
+}
+
+template<typename T>
+void epoch_stack<T>::push(const T& data)
+{
+    node* const new_node = new node(data);
+    new_node->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(new_node->next, new_node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template<typename T>
+void epoch_stack<T>::push(T&& data)
+{
+    node* const new_node = new node(std::move(data));
+    new_node->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(new_node->next, new_node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template<typename T>
+typename epoch_stack<T>::node* epoch_stack<T>::pop_node()
+{
+    epoch_guard guard;
+    //CAS失败时old_head被更新为新的头节点，它同样处于临界区的保护下，不需要重新发布
+    node* old_head = head.load(std::memory_order_acquire);
+    while (old_head && !head.compare_exchange_weak(old_head, old_head->next, std::memory_order_acquire, std::memory_order_acquire));
+    return old_head;
+}
+
+template<typename T>
+std::shared_ptr<T> epoch_stack<T>::pop()
+{
+    node* const old_head = pop_node();
+    if (!old_head) {
+        return std::shared_ptr<T>();
+    }
+    std::shared_ptr<T> res = std::make_shared<T>(std::move(old_head->data));
+    epoch_retire(old_head);
+    return res;
+}
+
+template<typename T>
+bool epoch_stack<T>::pop(T& value)
+{
+    node* const old_head = pop_node();
+    if (!old_head) {
+        return false;
+    }
+    value = std::move(old_head->data);
+    epoch_retire(old_head);
+    return true;
+}
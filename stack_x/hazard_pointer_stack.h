@@ -0,0 +1,113 @@
+#include <memory>
+#include <atomic>
+#include <utility>
+
+#include "../reclaim_x/hazard_pointer.h"
+
+/*
+    用风险指针（hazard pointer）回收节点的无锁栈，接口与lock_free_stack相同。
+    lock_free_stack的每次pop都要先用CAS循环增加外部计数器，这里只需要发布一个风险指针（一次store加一次fence），
+    节点弹出后交给hazard_retire，等没有线程的风险指针指向它时再释放。
+    数据直接存放在节点里，push只分配一次节点。
+*/
+template<typename T>
+class hazard_pointer_stack
+{
+private:
+    struct node
+    {
+        T data;
+        node* next;
+
+        template<typename... Args>
+        explicit node(Args&&... args) : data(std::forward<Args>(args)...), next(nullptr) {}
+    };
+
+    std::atomic<node*> head{nullptr};
+
+    node* pop_node(); //弹出头节点，返回的节点已经从栈上摘下，由调用者取走数据后retire
+
+public:
+    hazard_pointer_stack() = default;
+    hazard_pointer_stack(const hazard_pointer_stack&) = delete;
+    hazard_pointer_stack& operator=(const hazard_pointer_stack&) = delete;
+    ~hazard_pointer_stack();
+
+    void push(const T& data);
+    void push(T&& data);
+
+    std::shared_ptr<T> pop();
+    bool pop(T& value);
+};
+
+
+/*-------------------The following code is the implementation-----------------*/
+
+
+template<typename T>
+hazard_pointer_stack<T>::~hazard_pointer_stack()
+{
+    //析构时不会再有其他线程访问，直接释放
+    node* current = head.load(std::memory_order_relaxed);
+    while (current) {
+        node* const next = current->next;
+        delete current;
+        current = next;
+    }
+}
+
+template<typename T>
+void hazard_pointer_stack<T>::push(const T& data)
+{
+    node* const new_node = new node(data);
+    new_node->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(new_node->next, new_node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template<typename T>
+void hazard_pointer_stack<T>::push(T&& data)
+{
+    node* const new_node = new node(std::move(data));
+    new_node->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(new_node->next, new_node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template<typename T>
+typename hazard_pointer_stack<T>::node* hazard_pointer_stack<T>::pop_node()
+{
+    hazard_pointer hp;
+    for (;;) {
+        //风险指针保证old_head在读取next期间不会被释放，也就不会有ABA问题
+        node* old_head = hp.protect(head);
+        if (!old_head) {
+            return nullptr;
+        }
+        if (head.compare_exchange_strong(old_head, old_head->next, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return old_head;
+        }
+    }
+}
+
+template<typename T>
+std::shared_ptr<T> hazard_pointer_stack<T>::pop()
+{
+    node* const old_head = pop_node();
+    if (!old_head) {
+        return std::shared_ptr<T>();
+    }
+    std::shared_ptr<T> res = std::make_shared<T>(std::move(old_head->data));
+    hazard_retire(old_head);
+    return res;
+}
+
+template<typename T>
+bool hazard_pointer_stack<T>::pop(T& value)
+{
+    node* const old_head = pop_node();
+    if (!old_head) {
+        return false;
+    }
+    value = std::move(old_head->data);
+    hazard_retire(old_head);
+    return true;
+}
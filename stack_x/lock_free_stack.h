@@ -1,5 +1,21 @@
 #include <memory>
 #include <atomic>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+//自旋等待时提示CPU，让出流水线给同核的另一个超线程，也降低功耗
+inline void cpu_pause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
 
 template<typename T>
 struct node;
@@ -14,42 +30,375 @@ struct counted_node_ptr
 template<typename T>
 struct node
 {
-    std::shared_ptr<T> data;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage; //数据直接存放在节点里，由push构造、由弹出它的pop析构
     std::atomic<int> internal_count; //内部计数器，与上面的外部计数器结合来判断当前节点是否有其他线程指涉，如果加上外部计数器等于0就可以删除节点
     counted_node_ptr<T> next;
-    node(const T& data_) :
-        data(std::make_shared<T>(data_)),
-        internal_count(0)
+    std::atomic<node<T>*> free_next; //节点在空闲链表上时指向下一个空闲节点
+    bool recycled; //节点进过空闲链表，之后就一直由空闲链表管理，直到栈析构才释放
+    node() :
+        internal_count(0),
+        free_next(nullptr),
+        recycled(false)
     {}
+
+    T* value() { return reinterpret_cast<T*>(&storage); }
 };
 
+/*
+    head的原子存储。std::atomic<counted_node_ptr<T>>是16字节，GCC在没有-mcx16时会交给libatomic，可能内部加锁，
+    所以这里按平台选择实现：
+        1. 编译时带了-mcx16（定义了__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16），直接用cmpxchg16b做双字CAS
+        2. x86-64/aarch64上用户态地址只有48位，把外部计数器塞进指针的高16位，用8字节原子变量
+        3. 其他平台退回std::atomic<counted_node_ptr<T>>，是否无锁由is_lock_free()告知
+*/
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+
+template<typename T>
+class atomic_counted_ptr
+{
+private:
+    alignas(16) unsigned __int128 value;
+
+    static unsigned __int128 pack(const counted_node_ptr<T>& p)
+    {
+        return static_cast<unsigned __int128>(static_cast<uint32_t>(p.external_count)) |
+               (static_cast<unsigned __int128>(reinterpret_cast<uintptr_t>(p.ptr)) << 64);
+    }
+
+    static counted_node_ptr<T> unpack(unsigned __int128 v)
+    {
+        counted_node_ptr<T> p;
+        p.external_count = static_cast<int>(static_cast<uint32_t>(v));
+        p.ptr = reinterpret_cast<node<T>*>(static_cast<uintptr_t>(v >> 64));
+        return p;
+    }
+
+public:
+    static constexpr bool is_always_lock_free = true;
+    static constexpr unsigned count_bits = 32; //外部计数器可用的位数
+
+    explicit atomic_counted_ptr(const counted_node_ptr<T>& p) : value(pack(p)) {}
+
+    bool is_lock_free() const { return true; }
+
+    //分两次读8字节，结果可能是撕裂的，只能用作compare_exchange_strong的expected，由CAS来校验
+    counted_node_ptr<T> load(std::memory_order order) const
+    {
+        const uint64_t* halves = reinterpret_cast<const uint64_t*>(&value);
+        const uint64_t low = __atomic_load_n(&halves[0], static_cast<int>(order));
+        const uint64_t high = __atomic_load_n(&halves[1], static_cast<int>(order));
+        return unpack(static_cast<unsigned __int128>(low) | (static_cast<unsigned __int128>(high) << 64));
+    }
+
+    bool compare_exchange_strong(counted_node_ptr<T>& expected, const counted_node_ptr<T>& desired,
+                                 std::memory_order order, std::memory_order)
+    {
+        return compare_exchange_strong(expected, desired, order);
+    }
+
+    //lock cmpxchg16b本身就是全屏障，内存序参数只为和std::atomic保持同样的接口
+    bool compare_exchange_strong(counted_node_ptr<T>& expected, const counted_node_ptr<T>& desired,
+                                 std::memory_order = std::memory_order_seq_cst)
+    {
+        const unsigned __int128 old_value = pack(expected);
+        const unsigned __int128 previous = __sync_val_compare_and_swap(&value, old_value, pack(desired));
+        if (previous == old_value) {
+            return true;
+        }
+        expected = unpack(previous);
+        return false;
+    }
+};
+
+#elif defined(__x86_64__) || defined(__aarch64__)
+
+template<typename T>
+class atomic_counted_ptr
+{
+private:
+    static constexpr int pointer_bits = 48;
+    static constexpr uint64_t pointer_mask = (uint64_t(1) << pointer_bits) - 1;
+
+    std::atomic<uint64_t> value;
+
+    //外部计数器只有16位，同时在等待同一个节点的pop不能超过65535个
+    static uint64_t pack(const counted_node_ptr<T>& p)
+    {
+        const uint64_t address = reinterpret_cast<uintptr_t>(p.ptr);
+        assert((address & ~pointer_mask) == 0 && "node address does not fit in 48 bits");
+        assert(p.external_count >= 0 && p.external_count <= 0xffff);
+        return (static_cast<uint64_t>(p.external_count) << pointer_bits) | address;
+    }
+
+    static counted_node_ptr<T> unpack(uint64_t v)
+    {
+        counted_node_ptr<T> p;
+        p.external_count = static_cast<int>(v >> pointer_bits);
+        p.ptr = reinterpret_cast<node<T>*>(static_cast<uintptr_t>(v & pointer_mask));
+        return p;
+    }
+
+public:
+    static constexpr bool is_always_lock_free = std::atomic<uint64_t>::is_always_lock_free;
+    static constexpr unsigned count_bits = 64 - pointer_bits;
+
+    explicit atomic_counted_ptr(const counted_node_ptr<T>& p) : value(pack(p)) {}
+
+    bool is_lock_free() const { return value.is_lock_free(); }
+
+    counted_node_ptr<T> load(std::memory_order order) const
+    {
+        return unpack(value.load(order));
+    }
+
+    bool compare_exchange_strong(counted_node_ptr<T>& expected, const counted_node_ptr<T>& desired,
+                                 std::memory_order success, std::memory_order failure)
+    {
+        uint64_t old_value = pack(expected);
+        if (value.compare_exchange_strong(old_value, pack(desired), success, failure)) {
+            return true;
+        }
+        expected = unpack(old_value);
+        return false;
+    }
+
+    bool compare_exchange_strong(counted_node_ptr<T>& expected, const counted_node_ptr<T>& desired,
+                                 std::memory_order order = std::memory_order_seq_cst)
+    {
+        uint64_t old_value = pack(expected);
+        if (value.compare_exchange_strong(old_value, pack(desired), order)) {
+            return true;
+        }
+        expected = unpack(old_value);
+        return false;
+    }
+};
+
+#else
+
+template<typename T>
+class atomic_counted_ptr : public std::atomic<counted_node_ptr<T>>
+{
+public:
+    static constexpr bool is_always_lock_free = false;
+    static constexpr unsigned count_bits = 32;
+
+    explicit atomic_counted_ptr(const counted_node_ptr<T>& p) : std::atomic<counted_node_ptr<T>>(p) {}
+};
+
+#endif
+
 template<typename T>
 class lock_free_stack
 {
 private:
-    std::atomic<counted_node_ptr<T>> head;
+    atomic_counted_ptr<T> head;
     void increase_head_count(counted_node_ptr<T>&); //更新指针的外部计数器
 
+    /*
+        外部计数器只保留低16位（打包到指针高位时只有16位），节点长期在栈底时计数器会一直增长并回绕，
+        所以内部+外部计数器之和按模65536判断是否为0。同时指涉一个节点的线程数远小于65536，这个判断是准确的。
+    */
+    static constexpr unsigned external_count_mask = 0xffff;
+    static bool no_reference_left(int internal_before, int increase)
+    {
+        return ((static_cast<unsigned>(internal_before) + static_cast<unsigned>(increase)) & external_count_mask) == 0;
+    }
+
+    /*
+        消除数组（elimination array）：线程很多时，push和pop都在head上反复CAS失败，吞吐量反而下降。
+        CAS失败的push把节点挂到随机的一个槽位上等一会，同一时间CAS失败的pop到随机槽位上取走它，
+        这一对操作相互抵消（相当于push之后紧接着pop），完全不用碰head。
+        等不到对方就回到head上重试，每次重试的等待时间翻倍（退避）。
+        每个线程记录自己使用的槽位范围：槽位被别人占用（冲突多）时扩大范围，等不到对方（线程少）时缩小范围。
+    */
+    static constexpr unsigned elimination_slots = 16;
+    static constexpr unsigned elimination_min_spins = 16;
+    static constexpr unsigned elimination_max_attempt = 5; //等待时间最多翻5倍
+
+    struct alignas(64) elimination_slot
+    {
+        std::atomic<node<T>*> offer{nullptr}; //nullptr：空闲；taken_marker：节点已被pop取走，等push来清空；其他：等待中的节点
+    };
+    elimination_slot elimination[elimination_slots];
+
+    struct elimination_state
+    {
+        unsigned range = 1;
+        uint32_t seed = 0;
+    };
+    //每个线程一份，同一类型的栈共用
+    static elimination_state& local_elimination_state();
+
+    static node<T>* taken_marker() { return reinterpret_cast<node<T>*>(uintptr_t(1)); }
+    elimination_slot& pick_slot(elimination_state& state);
+    bool eliminate_push(node<T>* new_node, unsigned attempt); //返回true表示节点已交给一个pop
+    node<T>* eliminate_pop(unsigned attempt); //返回push交来的节点，没有等到返回nullptr
+
+    /*
+        空闲节点链表：没有线程再指涉的节点不delete，而是放进这里给下一次push复用，push/pop循环就不再分配内存。
+        链表头的计数器用作版本号，每次修改都加一，防止ABA。版本号有free_list_tag_bits位：
+        一个线程在读链表头和CAS之间被挂起时，如果恰好经过了2^free_list_tag_bits次空闲链表操作，CAS会用过时的free_next成功。
+        打包到指针高位时只有16位，65536次操作并不难凑够，所以不能容忍这种情况的使用者（比如线程池的对象池）
+        应该用-mcx16编译，得到32位的版本号。
+        allocate_node读到的链表头可能已经过时，它仍会去读这个节点的free_next，所以进过空闲链表的节点（recycled）
+        不能再被delete：之后每次放回都回到空闲链表，直到析构才释放。
+        free_list_capacity限制的是进过空闲链表的节点总数，超出后新放回的节点直接delete。为0时不回收节点。
+    */
+    atomic_counted_ptr<T> free_head;
+    //空闲链表的版本号加一，按计数器的位数回绕
+    static int next_free_tag(int tag)
+    {
+        const uint64_t mask = (uint64_t(1) << atomic_counted_ptr<T>::count_bits) - 1;
+        return static_cast<int>((static_cast<uint64_t>(static_cast<uint32_t>(tag)) + 1) & mask);
+    }
+    std::atomic<size_t> recycled_count;
+    const size_t free_list_capacity;
+
+    node<T>* allocate_node(); //优先从空闲链表取节点
+    bool admit_node(); //给一个新节点占用空闲链表的名额，名额用完返回false
+    void release_node(node<T>* ptr); //节点上已经没有数据，也没有线程指涉
+    void release_reference(node<T>* ptr, int count_increase); //给节点的内部计数器加上count_increase，没有线程指涉了就回收
+
+    /*
+        弹出一个元素，在该线程独占数据期间把它交给consume(T&&)，之后析构数据、放弃对节点的引用。
+        栈为空时返回false。
+    */
+    template<typename Consumer>
+    bool pop_value(Consumer&& consume);
+
 public:
+    //编译期判断：定义LOCK_FREE_STACK_REQUIRE_LOCK_FREE后，head不保证无锁的平台上直接编译失败
+    static constexpr bool is_always_lock_free = atomic_counted_ptr<T>::is_always_lock_free;
+    //空闲链表版本号的位数，见free_head的说明
+    static constexpr unsigned free_list_tag_bits = atomic_counted_ptr<T>::count_bits;
+#if defined(LOCK_FREE_STACK_REQUIRE_LOCK_FREE)
+    static_assert(is_always_lock_free, "lock_free_stack head is not lock-free on this platform");
+#endif
+
+    //std::atomic的默认构造不会初始化head
+    lock_free_stack() : lock_free_stack(0) {}
+    //最多保留free_list_capacity个空闲节点给之后的push复用
+    explicit lock_free_stack(size_t free_list_capacity) :
+        head(counted_node_ptr<T>{0, nullptr}),
+        free_head(counted_node_ptr<T>{0, nullptr}),
+        recycled_count(0),
+        free_list_capacity(free_list_capacity)
+    {}
+    lock_free_stack(const lock_free_stack&) = delete;
+    lock_free_stack& operator=(const lock_free_stack&) = delete;
     ~lock_free_stack();
 
+    //运行期判断：head的操作是否真的无锁
+    bool is_lock_free() const { return head.is_lock_free(); }
+
     void push(const T& data);
+    void push(T&& data);
+    template<typename... Args>
+    void emplace(Args&&... args); //直接在节点里构造数据
 
-    std::shared_ptr<T> pop();
+    std::shared_ptr<T> pop(); //每次都要分配shared_ptr，不需要共享所有权时用try_pop
+    bool try_pop(T& value); //栈为空时返回false
+
+    void reserve(size_t count); //预先往空闲链表里放count个节点（不超过free_list_capacity），之后的push不必再分配
 };
 
 
 /*-------------------The following code is the implementation-----------------*/
 
 
+template<typename T>
+typename lock_free_stack<T>::elimination_state& lock_free_stack<T>::local_elimination_state()
+{
+    static thread_local elimination_state state;
+    if (state.seed == 0) {
+        state.seed = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&state) >> 4) | 1;
+    }
+    return state;
+}
+
+template<typename T>
+typename lock_free_stack<T>::elimination_slot& lock_free_stack<T>::pick_slot(elimination_state& state)
+{
+    //xorshift32
+    state.seed ^= state.seed << 13;
+    state.seed ^= state.seed >> 17;
+    state.seed ^= state.seed << 5;
+    return elimination[state.seed % state.range];
+}
+
+template<typename T>
+bool lock_free_stack<T>::eliminate_push(node<T>* new_node, unsigned attempt)
+{
+    elimination_state& state = local_elimination_state();
+    elimination_slot& slot = pick_slot(state);
+
+    node<T>* expected = nullptr;
+    if (!slot.offer.compare_exchange_strong(expected, new_node, std::memory_order_release, std::memory_order_relaxed)) {
+        //槽位被占用，说明竞争的线程多，扩大范围
+        state.range = std::min(state.range * 2, elimination_slots);
+        return false;
+    }
+
+    const unsigned spins = elimination_min_spins << std::min(attempt, elimination_max_attempt);
+    for (unsigned i = 0; i < spins; i++) {
+        if (slot.offer.load(std::memory_order_acquire) == taken_marker()) {
+            slot.offer.store(nullptr, std::memory_order_relaxed);
+            return true;
+        }
+        cpu_pause();
+    }
+
+    //收回节点，如果收回失败说明在最后一刻被pop取走了
+    expected = new_node;
+    if (slot.offer.compare_exchange_strong(expected, nullptr, std::memory_order_relaxed, std::memory_order_relaxed)) {
+        //没有等到pop，说明竞争的线程少，缩小范围
+        state.range = std::max(state.range / 2, 1u);
+        return false;
+    }
+    slot.offer.store(nullptr, std::memory_order_relaxed);
+    return true;
+}
+
+template<typename T>
+node<T>* lock_free_stack<T>::eliminate_pop(unsigned attempt)
+{
+    elimination_state& state = local_elimination_state();
+    elimination_slot& slot = pick_slot(state);
+
+    const unsigned spins = elimination_min_spins << std::min(attempt, elimination_max_attempt);
+    for (unsigned i = 0; i < spins; i++) {
+        node<T>* offered = slot.offer.load(std::memory_order_relaxed);
+        if (offered == taken_marker()) {
+            //另一个pop刚取走这个槽位的节点
+            state.range = std::min(state.range * 2, elimination_slots);
+            return nullptr;
+        }
+        if (offered) {
+            if (slot.offer.compare_exchange_strong(offered, taken_marker(), std::memory_order_acquire, std::memory_order_relaxed)) {
+                return offered;
+            }
+            state.range = std::min(state.range * 2, elimination_slots);
+            return nullptr;
+        }
+        cpu_pause();
+    }
+    state.range = std::max(state.range / 2, 1u);
+    return nullptr;
+}
+
 template<typename T>
 void lock_free_stack<T>::increase_head_count(counted_node_ptr<T>& old_counter)
 {
     counted_node_ptr<T> new_counter;
 
     do {
+        //栈为空时不计数，否则空栈上的每次pop都会让head的计数器增长
+        if (!old_counter.ptr) {
+            return;
+        }
         new_counter = old_counter;
-        ++new_counter.external_count;
+        new_counter.external_count = (new_counter.external_count + 1) & external_count_mask;
     } while (!head.compare_exchange_strong(old_counter, new_counter, std::memory_order_acquire, std::memory_order_relaxed));
     //该循环确保在增加外部计数器的时候head没有遭受其他线程的改动
 
@@ -59,46 +408,188 @@ void lock_free_stack<T>::increase_head_count(counted_node_ptr<T>& old_counter)
 template<typename T>
 lock_free_stack<T>::~lock_free_stack()
 {
-    while (pop());
+    //析构时不会再有其他线程访问，直接释放栈上和空闲链表上的节点
+    node<T>* current = head.load(std::memory_order_relaxed).ptr;
+    while (current) {
+        node<T>* const next = current->next.ptr;
+        current->value()->~T();
+        delete current;
+        current = next;
+    }
+    current = free_head.load(std::memory_order_relaxed).ptr;
+    while (current) {
+        node<T>* const next = current->free_next.load(std::memory_order_relaxed);
+        delete current;
+        current = next;
+    }
+}
+
+template<typename T>
+node<T>* lock_free_stack<T>::allocate_node()
+{
+    if (free_list_capacity != 0) {
+        counted_node_ptr<T> old_top = free_head.load(std::memory_order_acquire);
+        while (old_top.ptr) {
+            counted_node_ptr<T> new_top;
+            new_top.ptr = old_top.ptr->free_next.load(std::memory_order_relaxed);
+            new_top.external_count = next_free_tag(old_top.external_count);
+            if (free_head.compare_exchange_strong(old_top, new_top, std::memory_order_acquire, std::memory_order_acquire)) {
+                return old_top.ptr;
+            }
+        }
+    }
+    return new node<T>();
+}
+
+template<typename T>
+bool lock_free_stack<T>::admit_node()
+{
+    size_t count = recycled_count.load(std::memory_order_relaxed);
+    while (count < free_list_capacity) {
+        if (recycled_count.compare_exchange_weak(count, count + 1, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename T>
+void lock_free_stack<T>::release_node(node<T>* ptr)
+{
+    if (!ptr->recycled) {
+        //第一次放回，名额用完了就直接释放：这个节点从没进过空闲链表，不会有线程再读它的free_next
+        if (!admit_node()) {
+            delete ptr;
+            return;
+        }
+        ptr->recycled = true;
+    }
+    ptr->internal_count.store(0, std::memory_order_relaxed);
+
+    counted_node_ptr<T> old_top = free_head.load(std::memory_order_relaxed);
+    counted_node_ptr<T> new_top;
+    new_top.ptr = ptr;
+    do {
+        ptr->free_next.store(old_top.ptr, std::memory_order_relaxed);
+        new_top.external_count = next_free_tag(old_top.external_count);
+    } while (!free_head.compare_exchange_strong(old_top, new_top, std::memory_order_release, std::memory_order_relaxed));
+}
+
+template<typename T>
+void lock_free_stack<T>::reserve(size_t count)
+{
+    for (size_t i = 0; i < count && admit_node(); ++i) {
+        node<T>* const ptr = new node<T>();
+        ptr->recycled = true;
+        release_node(ptr);
+    }
+}
+
+template<typename T>
+void lock_free_stack<T>::release_reference(node<T>* ptr, int count_increase)
+{
+    //如果内部引用计数器+外部引用计数器变成0，也就是内部引用计数器的原值等于-count_increase，就可以回收该节点
+    if (no_reference_left(ptr->internal_count.fetch_add(count_increase, std::memory_order_acq_rel), count_increase)) {
+        release_node(ptr);
+    }
 }
 
 template<typename T>
 void lock_free_stack<T>::push(const T& data)
+{
+    emplace(data);
+}
+
+template<typename T>
+void lock_free_stack<T>::push(T&& data)
+{
+    emplace(std::move(data));
+}
+
+template<typename T>
+template<typename... Args>
+void lock_free_stack<T>::emplace(Args&&... args)
 {
     counted_node_ptr<T> new_node;
-    new_node.ptr = new node<T>(data);
+    new_node.ptr = allocate_node();
+    try {
+        new (new_node.ptr->value()) T(std::forward<Args>(args)...);
+    } catch (...) {
+        release_node(new_node.ptr);
+        throw;
+    }
     new_node.external_count = 1;
     new_node.ptr->next = head.load(std::memory_order_relaxed);
     //该循环用于确保head指针正确被更新，放在其他线程在这里趁机修改head
-    while (!head.compare_exchange_strong(new_node.ptr->next, new_node, std::memory_order_release, std::memory_order_relaxed));
+    //CAS失败说明有竞争，先去消除数组找一个pop，找不到再回来重试
+    for (unsigned attempt = 0; !head.compare_exchange_strong(new_node.ptr->next, new_node, std::memory_order_release, std::memory_order_relaxed); attempt++) {
+        if (eliminate_push(new_node.ptr, attempt)) {
+            return;
+        }
+        new_node.ptr->next = head.load(std::memory_order_relaxed);
+    }
 }
 
 template<typename T>
-std::shared_ptr<T> lock_free_stack<T>::pop()
+template<typename Consumer>
+bool lock_free_stack<T>::pop_value(Consumer&& consume)
 {
+    //consume抛出异常时也要析构数据、放弃引用
+    struct popped_value
+    {
+        lock_free_stack* stack;
+        node<T>* ptr;
+        int count_increase;
+        bool referenced; //false表示节点来自消除数组，从未进过栈，没有其他线程指涉
+        ~popped_value()
+        {
+            ptr->value()->~T();
+            if (referenced) {
+                stack->release_reference(ptr, count_increase);
+            } else {
+                stack->release_node(ptr);
+            }
+        }
+    };
+
     counted_node_ptr<T> old_head = head.load(std::memory_order_relaxed);
-    for (;;) {
+    for (unsigned attempt = 0; ; attempt++) {
         increase_head_count(old_head); //先自增外部计数器
 
         node<T>* const ptr = old_head.ptr;
         //如果ptr为空，说明栈为空
         if (!ptr) {
-            return std::shared_ptr<T>();
+            return false;
         }
         //试图获得head的控制权
         if (head.compare_exchange_strong(old_head, ptr->next, std::memory_order_relaxed)) {
-            std::shared_ptr<T> res;
-            res.swap(ptr->data); //先获得data
-            const int count_increase = old_head.external_count - 2; //这里减2是因为我们将头节点弹出，这里-1，然后该线程也就是old_head不再指涉，再-1
-            //如果内部引用计数器+外部引用计数器变成0，也就是内部引用计数器的原值等于-count_increase，就可以删除该节点
-            if (ptr->internal_count.fetch_add(count_increase, std::memory_order_release) == -count_increase) {
-                delete ptr;
-            }
-            return res;
+            //这里减2是因为我们将头节点弹出，这里-1，然后该线程也就是old_head不再指涉，再-1
+            popped_value popped{this, ptr, old_head.external_count - 2, true};
+            consume(std::move(*ptr->value()));
+            return true;
         }
-        else if (ptr->internal_count.fetch_add(-1, std::memory_order_relaxed) == 1) { //如果该当前线程最后一个持有的线程，则棋内部引用计数器会变为1
-            ptr->internal_count.load(std::memory_order_acquire);
-            delete ptr;
+        //如果该当前线程最后一个持有的线程，则棋内部引用计数器会变为1
+        release_reference(ptr, -1);
+
+        //CAS失败说明有竞争，到消除数组等一个push
+        if (node<T>* const offered = eliminate_pop(attempt)) {
+            popped_value popped{this, offered, 0, false};
+            consume(std::move(*offered->value()));
+            return true;
         }
     }
-}
\ No newline at end of file
+}
+
+template<typename T>
+std::shared_ptr<T> lock_free_stack<T>::pop()
+{
+    std::shared_ptr<T> res;
+    pop_value([&res](T&& value) { res = std::make_shared<T>(std::move(value)); });
+    return res;
+}
+
+template<typename T>
+bool lock_free_stack<T>::try_pop(T& value)
+{
+    return pop_value([&value](T&& popped) { value = std::move(popped); });
+}
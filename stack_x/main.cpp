@@ -1,6 +1,8 @@
 #include "lock_free_stack.h"
+#include <atomic>
 #include <iostream>
 #include <thread>
+#include <vector>
 
 lock_free_stack<int> my_stack;
 
@@ -24,10 +26,47 @@ void work2()
     std::cout << cnt << std::endl;
 }
 
+/*
+    空闲链表容量很小时的压力测试：节点不停地进出空闲链表，名额满了的节点被直接释放。
+    用-fsanitize=address编译运行，allocate_node读到过时的链表头时不能访问已释放的节点。
+*/
+bool stress_bounded_free_list()
+{
+    lock_free_stack<int> stack(1);
+    std::atomic<long long> pushed(0), popped(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 32; t++) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 20000; i++) {
+                if ((i + t) % 2) {
+                    stack.push(i);
+                    pushed += i;
+                } else {
+                    int value;
+                    if (stack.try_pop(value)) {
+                        popped += value;
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+    int value;
+    while (stack.try_pop(value)) {
+        popped += value;
+    }
+    return pushed == popped;
+}
+
 int main()
 {
     std::thread t1(work1), t2(work2);
     t1.join();
     t2.join();
-    return 0;
+
+    const bool ok = stress_bounded_free_list();
+    std::cout << "bounded free list stress: " << (ok ? "ok" : "FAILED") << std::endl;
+    return ok ? 0 : 1;
 }
\ No newline at end of file
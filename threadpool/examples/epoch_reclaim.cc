@@ -0,0 +1,58 @@
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+
+#include "thread_pool.h"
+#include "../../stack_x/epoch_stack.h"
+using namespace arrow;
+
+int main()
+{
+   auto threadPool = *ThreadPool::Make(2);
+
+   // A task blocked for a while, like a pipeline stage waiting on its channel
+   std::mutex mutex;
+   std::condition_variable cv;
+   bool released = false;
+   bool blocked = false;
+   threadPool->Spawn([&]() {
+      std::unique_lock<std::mutex> lock(mutex);
+      blocked = true;
+      cv.notify_all();
+      cv.wait(lock, [&] { return released; });
+   });
+   {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&] { return blocked; });
+   }
+
+   // Meanwhile the other worker and this thread keep retiring nodes
+   epoch_stack<int> stack;
+   const uint64_t before = epoch_detail::global.epoch.load();
+   threadPool->Spawn([&]() {
+      for (int i = 0; i < 10000; ++i) {
+         int value;
+         stack.push(i);
+         stack.pop(value);
+      }
+   });
+   for (int i = 0; i < 10000; ++i) {
+      int value;
+      stack.push(i);
+      stack.pop(value);
+   }
+   epoch_collect();
+   const uint64_t after = epoch_detail::global.epoch.load();
+
+   // Workers stay offline while they run a task, so the blocked one doesn't hold the epoch back
+   std::cout << "epoch while a task blocks : " << before << " -> " << after
+             << (after > before + 1 ? " (retired nodes get freed)" : " (stuck)") << std::endl;
+
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      released = true;
+   }
+   cv.notify_all();
+   threadPool->WaitForIdle();
+   return after > before + 1 ? 0 : 1;
+}
@@ -0,0 +1,56 @@
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include "cancel.h"
+#include "io_util.h"
+#include "macros.h"
+#include "pipeline.h"
+#include "thread_pool.h"
+using namespace arrow;
+
+int main() 
+{
+   auto threadPool = *ThreadPool::Make(8);
+
+   // source -> square (4 tasks, order preserved) -> format -> slow sink
+   int next = 0;
+   std::string last;
+   int received = 0;
+   bool ordered = true;
+
+   Pipeline pipeline = Pipeline::From<int>([&]() -> std::optional<int> {
+                          if ( next == 1000 ) {
+                             return {};
+                          }
+                          return next++;
+                       })
+                       .Then([](int value) { return static_cast<int64_t>(value) * value; },
+                             Pipeline::StageOptions{4, true, 8})
+                       .Then([](int64_t value) { return std::to_string(value); })
+                       .To([&](std::string value) {
+                          // The sink is the bottleneck, the channels in front of it keep memory bounded
+                          std::this_thread::sleep_for(std::chrono::microseconds(50));
+                          ordered = ordered && value == std::to_string(static_cast<int64_t>(received) * received);
+                          received++;
+                          last = std::move(value);
+                       });
+
+   Status status = pipeline.Run(threadPool.get()).get();
+   std::cout << "run : " << status.ToString() << ", received " << received << " items "
+             << (ordered ? "in order" : "OUT OF ORDER") << ", last " << last << std::endl;
+
+   // Stopping the run stops every stage
+   StopSource stop_source;
+   next = 0;
+   received = 0;
+   auto future = pipeline.Run(threadPool.get(), stop_source.token());
+   std::this_thread::sleep_for(std::chrono::milliseconds(5));
+   stop_source.RequestStop();
+   std::cout << "stopped run : " << future.get().ToString() << ", received " << received << " items" << std::endl;
+
+   // Shutdown the thread pool
+   threadPool->Shutdown();
+}
@@ -0,0 +1,44 @@
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "cancel.h"
+#include "io_util.h"
+#include "macros.h"
+#include "serial_executor.h"
+#include "thread_pool.h"
+using namespace arrow;
+
+int main() 
+{
+   auto threadPool = GetCpuThreadPool();
+
+   // Two strands sharing the same thread pool, each one keeps its own ordering
+   std::vector<std::shared_ptr<SerialExecutor>> strands;
+   for (int i = 0; i < 2; ++i) {
+      strands.push_back(*SerialExecutor::Make(threadPool));
+   }
+
+   // No mutex is needed around the per-strand state, its tasks never run concurrently
+   std::vector<std::vector<int>> seen(strands.size());
+   for (int i = 0; i < 1000; ++i) {
+      for (size_t s = 0; s < strands.size(); ++s) {
+         strands[s]->Spawn([&seen, s, i]() { seen[s].push_back(i); });
+      }
+   }
+
+   // Wait for all tasks to complete
+   threadPool->WaitForIdle();
+
+   for (size_t s = 0; s < strands.size(); ++s) {
+      bool ordered = seen[s].size() == 1000;
+      for (size_t i = 0; ordered && i < seen[s].size(); ++i) {
+         ordered = seen[s][i] == static_cast<int>(i);
+      }
+      std::cout << "strand " << s << " ran " << seen[s].size() << " tasks "
+                << (ordered ? "in order" : "OUT OF ORDER") << std::endl;
+   }
+
+   // Shutdown the thread pool
+   threadPool->Shutdown();
+}
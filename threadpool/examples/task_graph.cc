@@ -0,0 +1,87 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "cancel.h"
+#include "io_util.h"
+#include "macros.h"
+#include "task_graph.h"
+#include "thread_pool.h"
+using namespace arrow;
+
+int main() 
+{
+   auto threadPool = GetCpuThreadPool();
+
+   // A diamond : load -> (parse, index) -> report, parse being the expensive branch
+   TaskGraph graph;
+   std::atomic<int> loaded{0}, parsed{0}, indexed{0};
+
+   auto load = graph.AddNode([&]() { loaded++; return Status::OK(); });
+
+   TaskHints heavy;
+   heavy.cpu_cost = 1000;
+   auto parse = graph.AddNode([&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      parsed++;
+      return Status::OK();
+   }, heavy);
+
+   auto index = graph.AddNode([&]() { indexed++; return Status::OK(); });
+
+   auto report = graph.AddNode([&]() {
+      std::cout << "report sees loaded=" << loaded << " parsed=" << parsed << " indexed=" << indexed << std::endl;
+      return Status::OK();
+   });
+
+   graph.AddEdge(load, parse);
+   graph.AddEdge(load, index);
+   graph.AddEdge(parse, report);
+   graph.AddEdge(index, report);
+
+   // The same graph can run several times
+   for (int i = 0; i < 3; ++i) {
+      Status status = graph.Run(threadPool).get();
+      std::cout << "run " << i << " : " << status.ToString() << std::endl;
+   }
+
+   // A stopped run skips the nodes not started yet
+   StopSource stop_source;
+   stop_source.RequestStop();
+   Status status = graph.Run(threadPool, stop_source.token()).get();
+   std::cout << "stopped run : " << status.ToString() << std::endl;
+
+   /*
+      With the Priority policy the most critical ready node runs first, even when it became ready last.
+      On a single worker : `slow` runs first and `critical` becomes ready while `light` already waits,
+         still `critical` runs before `light` (with SchedulingPolicy::Fifo, `light` would run first).
+   */
+   auto ranked = *ThreadPool::Make(1);
+   ThreadPool::SchedulingOptions scheduling;
+   scheduling.policy = SchedulingPolicy::Priority;
+   ranked->SetSchedulingOptions(scheduling);
+
+   TaskGraph two_paths;
+   auto named = [](const char* name) {
+      return [name]() { std::cout << "  " << name << std::endl; return Status::OK(); };
+   };
+   auto slow = two_paths.AddNode([]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      std::cout << "  slow" << std::endl;
+      return Status::OK();
+   });
+   TaskHints expensive;
+   expensive.cpu_cost = 100;
+   auto critical = two_paths.AddNode(named("critical"), expensive);
+   two_paths.AddNode(named("light"));
+   two_paths.AddEdge(slow, critical);
+
+   std::cout << "priority order :" << std::endl;
+   Status ranked_status = two_paths.Run(ranked.get()).get();
+   std::cout << "priority run : " << ranked_status.ToString() << std::endl;
+   ranked->Shutdown();
+
+   // Shutdown the thread pool
+   threadPool->Shutdown();
+}
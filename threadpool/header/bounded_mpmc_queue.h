@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace arrow
+{
+
+namespace internal
+{
+
+/*
+   Brief :
+      A bounded lock-free multi-producer/multi-consumer FIFO queue (Dmitry Vyukov's algorithm).
+
+   Detailed :
+      The queue is a ring of cells, each one carrying a sequence number telling whether it is ready to be written or read
+         for the current lap around the ring.
+      A producer claims a cell by advancing enqueue_pos_ with a CAS, fills it and then publishes it by bumping its sequence.
+      Consumers do the same on the other side with dequeue_pos_.
+      Neither side ever waits for the other, TryPush() fails when the ring is full and TryPop() when it is empty.
+
+   Note :
+      T must be default constructible and move assignable.
+*/
+template <typename T>
+class BoundedMpmcQueue
+{
+public:
+   // The capacity is rounded up to a power of two
+   explicit BoundedMpmcQueue(size_t capacity)
+   {
+      size_t size = 2;
+      while ( size < capacity )
+      {
+         size *= 2;
+      }
+      mask_ = size - 1;
+      cells_.reset(new Cell[size]);
+      for (size_t i = 0; i < size; i++)
+      {
+         cells_[i].sequence.store(i, std::memory_order_relaxed);
+      }
+   }
+
+   BoundedMpmcQueue(const BoundedMpmcQueue&) = delete;
+   BoundedMpmcQueue& operator=(const BoundedMpmcQueue&) = delete;
+
+   /*
+      Brief :
+         Queue a value.
+
+      Return :
+         false if the queue is full, `value` is then left untouched.
+   */
+   bool TryPush(T&& value)
+   {
+      size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+      for (;;)
+      {
+         Cell& cell = cells_[pos & mask_];
+         const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+         const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+         if ( diff == 0 )
+         {
+            // The cell is free for this lap, try to claim it
+            if ( enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) )
+            {
+               cell.value = std::move(value);
+               cell.sequence.store(pos + 1, std::memory_order_release);
+               return true;
+            }
+         }
+         else if ( diff < 0 )
+         {
+            // The cell still holds a value of the previous lap
+            return false;
+         }
+         else
+         {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+         }
+      }
+   }
+
+   /*
+      Brief :
+         Take the oldest value.
+
+      Return :
+         false if the queue is empty.
+   */
+   bool TryPop(T* value)
+   {
+      size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+      for (;;)
+      {
+         Cell& cell = cells_[pos & mask_];
+         const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+         const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+         if ( diff == 0 )
+         {
+            // The cell was published for this lap, try to claim it
+            if ( dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) )
+            {
+               *value = std::move(cell.value);
+               // Make the cell available to the producers of the next lap
+               cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+               return true;
+            }
+         }
+         else if ( diff < 0 )
+         {
+            return false;
+         }
+         else
+         {
+            pos = dequeue_pos_.load(std::memory_order_relaxed);
+         }
+      }
+   }
+
+private:
+   struct alignas(64) Cell
+   {
+      std::atomic<size_t> sequence;
+      T value;
+   };
+
+   std::unique_ptr<Cell[]> cells_;
+   size_t mask_;
+
+   // Producers and consumers write different cache lines
+   alignas(64) std::atomic<size_t> enqueue_pos_{0};
+   alignas(64) std::atomic<size_t> dequeue_pos_{0};
+};
+
+}  // namespace internal
+
+}  // namespace arrow
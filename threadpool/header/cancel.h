@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
@@ -13,6 +14,8 @@ namespace arrow
 
 class StopToken;
 
+class StopCallbackRegistration;
+
 struct StopSourceImpl;
 
 /*
@@ -61,6 +64,39 @@ public:
          Determine whether to request a stop
    */
    bool IsStopRequested() const;
+
+private:
+   friend class StopCallbackRegistration;
+};
+
+/*
+   Brief :
+      Call a function once a stop is requested on the token, for as long as the registration is alive.
+
+   Detailed :
+      If a stop was already requested, the function is called right away by the constructor.
+      Otherwise it is called by the thread calling RequestStop(), and the destructor waits for a call in progress,
+         so that the function may safely refer to objects outliving the registration.
+      Registering on an unstoppable token does nothing.
+
+   Note :
+      RequestStopFromSignal() does not call the functions, as it must stay async-signal-safe.
+      The function must neither destroy its own registration nor request a stop on the same source.
+*/
+class ARROW_EXPORT StopCallbackRegistration
+{
+public:
+   StopCallbackRegistration(const StopToken& token, std::function<void()> callback);
+   ~StopCallbackRegistration();
+
+   StopCallbackRegistration(const StopCallbackRegistration&) = delete;
+   StopCallbackRegistration& operator=(const StopCallbackRegistration&) = delete;
+
+private:
+   std::shared_ptr<StopSourceImpl> impl_;
+
+   // 0 when not registered
+   uint64_t id_ = 0;
 };
 
 }  // namespace arrow
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "visibility.h"
+
+namespace arrow
+{
+
+namespace internal
+{
+
+/*
+   Brief :
+      A CPU the process may run on, and where it sits in the machine.
+*/
+struct CpuInfo
+{
+   int cpu = 0;
+
+   // Socket of the CPU
+   int package = 0;
+
+   // Physical core of the CPU, hyper-threads of a core share it. Only unique within a package
+   int core = 0;
+};
+
+/*
+   Brief :
+      A NUMA node and the CPUs of the process cpuset it holds.
+*/
+struct NumaNode
+{
+   int id = 0;
+   std::vector<int> cpus;
+};
+
+/*
+   Brief :
+      Return the CPUs of the process cpuset, sorted by CPU number.
+
+   Detailed :
+      The cpuset is read with sched_getaffinity(), the topology from /sys/devices/system/cpu.
+      A CPU whose topology cannot be read is assumed to be a core of its own on package 0.
+
+   Note :
+      Empty if the cpuset cannot be read.
+*/
+ARROW_EXPORT std::vector<CpuInfo> GetAllowedCpus();
+
+/*
+   Brief :
+      Return the NUMA nodes holding CPUs of the process cpuset, sorted by id.
+
+   Detailed :
+      Nodes are read from /sys/devices/system/node, memory-only nodes are left out.
+      Without NUMA support, or if the topology cannot be read, a single node 0 holds every CPU of the cpuset.
+*/
+ARROW_EXPORT std::vector<NumaNode> GetNumaNodes();
+
+/*
+   Brief :
+      Return the CPU bandwidth limit of the process cgroup, as a number of CPUs (e.g. 2.5 for 250ms every 100ms).
+
+   Detailed :
+      cgroup v2 (cpu.max) and v1 (cpu.cfs_quota_us and cpu.cfs_period_us) are both supported.
+      The tightest limit among the process cgroup and its ancestors wins.
+
+   Return :
+      An empty optional if there is no limit or it cannot be read.
+*/
+ARROW_EXPORT std::optional<double> GetCgroupCpuLimit();
+
+/*
+   Brief :
+      Return the number of CPUs the process can keep busy : the size of its cpuset, lowered to its cgroup CPU limit rounded up.
+
+   Return :
+      0 if it cannot be determined.
+*/
+ARROW_EXPORT int GetAvailableCpuCount();
+
+/*
+   Brief :
+      Order the CPUs so that consecutive ones share as much as possible :
+         the hyper-threads of a core first, then the cores of a package, then the next package.
+*/
+ARROW_EXPORT std::vector<int> CompactCpuOrder(std::vector<CpuInfo> cpus);
+
+/*
+   Brief :
+      Order the CPUs so that consecutive ones share as little as possible :
+         one core of each package in turn, and the second hyper-thread of a core only once every core has been used.
+*/
+ARROW_EXPORT std::vector<int> ScatterCpuOrder(std::vector<CpuInfo> cpus);
+
+/*
+   Brief :
+      Parse a CPU list in the kernel format, e.g. "0-3,8,10-11", surrounding whitespace is ignored.
+
+   Return :
+      An empty optional if the list is malformed.
+*/
+ARROW_EXPORT std::optional<std::vector<int>> ParseCpuList(const std::string& text);
+
+}  // namespace internal
+
+}  // namespace arrow
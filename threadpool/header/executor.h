@@ -1,5 +1,8 @@
 #pragma once
 
+#include <chrono>
+#include <optional>
+
 #include "cancel.h"
 #include "status.h"
 
@@ -8,7 +11,7 @@ namespace arrow
 
 /*
    Hints about a task that may be used by an Executor.
-   They are ignored by the provided ThreadPool implementation.
+   The provided ThreadPool only uses them if asked to by its SchedulingOptions.
 */
 struct TaskHints
 {
@@ -21,8 +24,17 @@ struct TaskHints
    // The approximate CPU cost in number of instructions
    int64_t cpu_cost = -1;
    
-   // An application-specific ID
+   // An application-specific ID, tasks sharing an ID have affinity with the same worker. See SchedulingPolicy::KeyAffinity
    int64_t external_id = -1;
+
+   // The time by which the task should have started. See SchedulingPolicy::EarliestDeadline
+   std::optional<std::chrono::steady_clock::time_point> deadline;
+
+   // The tenant on whose behalf the task runs. See SchedulingPolicy::FairShare
+   int64_t tenant_id = -1;
+
+   // The NUMA node to run the task on, -1 for the node of the submitting thread. See SchedulingPolicy::NumaLocal
+   int numa_node = -1;
 };
 
 /*
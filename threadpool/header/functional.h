@@ -1,5 +1,7 @@
 #pragma once
 
+#include "object_pool.h"
+
 namespace arrow
 {
 
@@ -20,7 +22,8 @@ template <typename R, typename... A>
 class FnOnce<R(A...)>
 {
 private:
-   struct Impl
+   // The callable is stored in a pooled block, so that spawning a task doesn't go through the allocator
+   struct Impl : PoolAllocated
    {
       virtual ~Impl() = default;
       virtual R invoke(A&&... a) = 0;
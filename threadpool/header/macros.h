@@ -24,6 +24,22 @@
 */
 #define ARROW_PREDICT_FALSE(x) (__builtin_expect(!!(x), 0))
 
+/*
+   Brief :
+      Hint the CPU that we are in a busy-wait loop.
+
+   Detailed :
+      On x86 the pause instruction lowers the power drawn by the loop, leaves the pipeline to the sibling hyper-thread
+         and avoids the memory order violation penalty when the awaited store finally arrives.
+*/
+#if defined(__x86_64__) || defined(__i386__)
+#define ARROW_CPU_PAUSE() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define ARROW_CPU_PAUSE() __asm__ __volatile__("yield")
+#else
+#define ARROW_CPU_PAUSE() ((void)0)
+#endif
+
 /*
    check the val1 is greater equal val2
 */
@@ -61,4 +77,4 @@
       { \
          std::abort(); \
       } \
-   }while( false )
\ No newline at end of file
+   }while( false )
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+#include "visibility.h"
+
+namespace arrow
+{
+
+namespace internal
+{
+
+/*
+   Brief :
+      Allocate a block of at least `size` bytes from the block pool, aligned like ::operator new.
+
+   Detailed :
+      Small blocks are sorted into size classes (multiples of kPoolGranularity up to kPoolMaxSize).
+      Every thread keeps a cache of free blocks per class and serves itself from it without any atomic operation.
+      When its cache overflows, a thread hands a batch of blocks over to the global free list of the class,
+         a lock-free stack (see stack_x/lock_free_stack.h), and it takes a whole batch back from there when its cache runs dry.
+      So blocks freed by one thread, like the consumer of a queue, flow back to the threads which allocate.
+      Only when no free block is left anywhere does the pool call into the allocator, blocks are never given back to it.
+
+      Larger blocks go straight to ::operator new.
+*/
+ARROW_EXPORT void* PoolAllocate(size_t size);
+
+/*
+   Brief :
+      Give back a block obtained from PoolAllocate(size), with the same size.
+*/
+ARROW_EXPORT void PoolFree(void* block, size_t size);
+
+/*
+   Brief :
+      Hand the blocks cached by the calling thread over to the global free lists, in whole batches.
+
+   Detailed :
+      Called by a thread about to go idle, like a parking ThreadPool worker,
+         so that the blocks it freed serve the threads which keep allocating instead of the allocator.
+      Less than a batch of blocks per size class stays in the cache.
+*/
+ARROW_EXPORT void PoolFlushThreadCache();
+
+constexpr size_t kPoolGranularity = 16;
+constexpr size_t kPoolMaxSize = 512;
+
+/*
+   Brief :
+      Create and destroy objects of type T in blocks recycled through PoolAllocate() and PoolFree().
+
+   Note :
+      Objects of every type of the same size class share their blocks.
+*/
+template <typename T>
+class ObjectPool
+{
+public:
+   static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "over-aligned types can't be pooled");
+
+   template <typename... Args>
+   static T* New(Args&&... args)
+   {
+      void* block = PoolAllocate(sizeof(T));
+      try
+      {
+         return new (block) T(std::forward<Args>(args)...);
+      }
+      catch (...)
+      {
+         PoolFree(block, sizeof(T));
+         throw;
+      }
+   }
+
+   static void Delete(T* object)
+   {
+      if ( object != nullptr )
+      {
+         object->~T();
+         PoolFree(object, sizeof(T));
+      }
+   }
+};
+
+/*
+   Brief :
+      Base class giving a class pooled operator new / delete, a `new Derived` then reuses a block of its size class.
+
+   Note :
+      Deleting through a base pointer needs a virtual destructor, the size passed to operator delete is then the derived one.
+      Over-aligned classes keep using the aligned ::operator new.
+*/
+struct PoolAllocated
+{
+   static void* operator new(size_t size) { return PoolAllocate(size); }
+   static void operator delete(void* block, size_t size) { PoolFree(block, size); }
+
+   static void* operator new(size_t size, std::align_val_t alignment) { return ::operator new(size, alignment); }
+   static void operator delete(void* block, size_t size, std::align_val_t alignment)
+   {
+      ::operator delete(block, size, alignment);
+   }
+};
+
+}  // namespace internal
+
+}  // namespace arrow
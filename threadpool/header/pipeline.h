@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cancel.h"
+#include "functional.h"
+#include "status.h"
+#include "visibility.h"
+#include "executor.h"
+#include "thread_pool.h"
+
+namespace arrow
+{
+
+/*
+   Brief :
+      A streaming pipeline : a source, transform stages and a sink, connected by bounded channels.
+
+   Detailed :
+      Build it with From(), Then() and To() :
+         auto pipeline = Pipeline::From<int>(read).Then(parse).Then(enrich, {4}).To(write);
+      Every stage runs `parallelism` long-lived tasks on the ThreadPool, pulling items from the bounded channel in front of it.
+      A full channel blocks the stage feeding it, so the throughput is that of the slowest stage
+         and the number of items in flight is bounded by the channel capacities and the parallelism.
+      A stage with preserve_order emits its items in the order it received them, the sink then sees them in source order
+         if every stage with a parallelism above 1 preserves order.
+
+   Note :
+      Stage functions of a stage with a parallelism above 1 are called concurrently.
+      A pipeline can be run several times, each run works on its own copy of the source and stage functions.
+*/
+class ARROW_EXPORT Pipeline
+{
+public:
+   struct StageOptions
+   {
+      // Number of tasks running the stage
+      int parallelism = 1;
+
+      // Emit items in the order they were received, a task only processes an item less than `parallelism` ahead
+      // of the next one to emit, which bounds the reorder buffer to `parallelism` - 1 items
+      bool preserve_order = false;
+
+      // Capacity of the channel feeding the stage
+      size_t channel_capacity = 16;
+   };
+
+   template <typename T>
+   class Builder;
+
+   /*
+      Brief :
+         Start a pipeline with a source, called repeatedly from a single task until it returns an empty optional.
+   */
+   template <typename T, typename Function>
+   static Builder<T> From(Function source);
+
+   /*
+      Brief :
+         Return the number of tasks a run needs on the pool, the source included.
+   */
+   int GetTotalParallelism() const;
+
+   /*
+      Brief :
+         Run the pipeline on the given pool.
+
+      Detailed :
+         Once stop_token is triggered, or a stage function throws, or the pool shuts down, every stage stops between two items
+            and the run fails with the corresponding status.
+
+      Return :
+         A future set once every task of the run has exited.
+         An Invalid status if the pool capacity is below GetTotalParallelism(), as the stages would wait for each other forever.
+
+      Note :
+         Waiting on the future from a task of the same pool may deadlock it.
+   */
+   std::future<Status> Run(ThreadPool* pool, StopToken stop_token = StopToken::Unstoppable());
+
+   /*
+      Brief :
+         Items travel type-erased between stages, the builder restores their types.
+   */
+   using Erased = std::shared_ptr<void>;
+
+   struct Stage
+   {
+      std::function<Erased(Erased)> process;
+      StageOptions options;
+      bool sink = false;
+   };
+
+private:
+   Pipeline() = default;
+
+   std::function<std::optional<Erased>()> source_;
+   std::vector<Stage> stages_;
+};
+
+/*
+   Brief :
+      A pipeline under construction whose last stage produces items of type T.
+*/
+template <typename T>
+class Pipeline::Builder
+{
+public:
+   /*
+      Brief :
+         Append a transform stage, calling `function` with each item.
+   */
+   template <typename Function, typename Out = std::invoke_result_t<Function&, T>>
+   Builder<Out> Then(Function function, StageOptions options = StageOptions{}) &&
+   {
+      Stage stage;
+      stage.options = options;
+      stage.process = [function = std::move(function)](Erased item) mutable -> Erased
+      {
+         return std::make_shared<Out>(function(std::move(*std::static_pointer_cast<T>(item))));
+      };
+      pipeline_.stages_.push_back(std::move(stage));
+      return Builder<Out>(std::move(pipeline_));
+   }
+
+   /*
+      Brief :
+         Finish the pipeline with a sink, calling `function` with each item.
+
+      Note :
+         With preserve_order, the sink is called one item at a time in source order.
+   */
+   template <typename Function>
+   Pipeline To(Function function, StageOptions options = StageOptions{}) &&
+   {
+      Stage stage;
+      stage.options = options;
+      stage.sink = true;
+      stage.process = [function = std::move(function)](Erased item) mutable -> Erased
+      {
+         function(std::move(*std::static_pointer_cast<T>(item)));
+         return nullptr;
+      };
+      pipeline_.stages_.push_back(std::move(stage));
+      return std::move(pipeline_);
+   }
+
+private:
+   friend class Pipeline;
+
+   template <typename>
+   friend class Builder;
+
+   explicit Builder(Pipeline pipeline) : pipeline_(std::move(pipeline)) {}
+
+   Pipeline pipeline_;
+};
+
+template <typename T, typename Function>
+Pipeline::Builder<T> Pipeline::From(Function source)
+{
+   Pipeline pipeline;
+   pipeline.source_ = [source = std::move(source)]() mutable -> std::optional<Erased>
+   {
+      std::optional<T> item = source();
+      if ( !item.has_value() )
+      {
+         return {};
+      }
+      return Erased(std::make_shared<T>(*std::move(item)));
+   };
+   return Builder<T>(std::move(pipeline));
+}
+
+}  // namespace arrow
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <optional>
+
+#include "cancel.h"
+#include "functional.h"
+#include "status.h"
+#include "visibility.h"
+#include "executor.h"
+
+namespace arrow
+{
+
+/*
+   Brief :
+      An Executor adapter (a "strand") running its tasks one at a time, in submission order, on top of another executor.
+
+   Detailed :
+      Submitted tasks are pushed to a lock-free multi-producer/single-consumer queue owned by the strand.
+      The submission which finds the strand idle schedules a single drain task on the underlying executor,
+         the drain task then runs queued tasks back to back until the queue is empty.
+      Because at most one drain task exists at any time, tasks of a strand never run concurrently
+         and no worker of the underlying executor ever blocks waiting for them.
+      Many strands can share the same underlying executor.
+
+   Note :
+      To stay fair to other users of the underlying executor, a drain task runs at most kMaxBatchSize tasks
+         and then reschedules itself at the back of the underlying executor's queue.
+      The underlying executor must outlive the strand and any task still queued on it.
+*/
+class ARROW_EXPORT SerialExecutor : public Executor
+{
+public:
+   /*
+      Brief :
+         Properties of the strand, shared with the drain task in flight.
+   */
+   struct State;
+
+   /*
+      Brief :
+         Maximum number of tasks run by one drain task before it yields to the underlying executor.
+   */
+   static constexpr int kMaxBatchSize = 64;
+
+   /*
+      Brief :
+         Construct a strand running its tasks on the given executor.
+   */
+   static std::optional<std::shared_ptr<SerialExecutor>> Make(Executor* executor);
+
+   /*
+      Brief :
+         Destroy the strand.
+
+      Note :
+         Tasks already submitted are still run, the drain task keeps the strand's state alive.
+   */
+   ~SerialExecutor() override;
+
+   /*
+      Brief :
+         Return the number of tasks either running or in the queue of this strand.
+   */
+   int GetNumTasks();
+
+   /*
+      Brief :
+         Determine if the current thread is running a task of this strand.
+   */
+   bool OwnsThisThread();
+
+   /*
+      Brief :
+         Override the father's class SpawnReal.
+
+      Note :
+         If the drain task cannot be scheduled on the underlying executor, every task queued on the strand
+            is cancelled through its StopCallback and the underlying error is returned.
+   */
+   Status SpawnReal(TaskHints hints, internal::FnOnce<void()> task, StopToken, StopCallback&&) override;
+
+protected:
+   explicit SerialExecutor(Executor* executor);
+
+   std::shared_ptr<State> sp_state_;
+   State* state_;
+};
+
+}  // namespace arrow
@@ -8,7 +8,8 @@ enum class StatusCode
    INVALID = -1, 
    OK = 0, 
    Cancelled = 1, 
-   KeyError = 2 
+   KeyError = 2,
+   DeadlineExceeded = 3
 };
 
 class Status
@@ -45,6 +46,11 @@ public:
       return Status(StatusCode::KeyError, msg);
    }
 
+   static Status DeadlineExceeded(const std::string& msg)
+   {
+      return Status(StatusCode::DeadlineExceeded, msg);
+   }
+
    std::string ToString() const 
    {
       std::string statusString;
@@ -57,6 +63,9 @@ public:
          case StatusCode::Cancelled:
             statusString = "Cancelled";
             break;
+         case StatusCode::DeadlineExceeded:
+            statusString = "Deadline exceeded";
+            break;
          default:
             statusString = "Unknown";
             break;
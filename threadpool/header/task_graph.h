@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "cancel.h"
+#include "functional.h"
+#include "status.h"
+#include "visibility.h"
+#include "executor.h"
+
+namespace arrow
+{
+
+/*
+   Brief :
+      A graph of tasks with dependencies, run on an Executor without any task blocking on another.
+
+   Detailed :
+      Nodes are added with AddNode() and ordered with AddEdge(), then Run() executes the graph.
+      Every node of a run keeps an atomic count of its unfinished predecessors,
+         the node whose count drops to zero is spawned right away through Executor::SpawnReal().
+      When several nodes become ready at once, the ones heading the longest remaining path are spawned first.
+      The length of a path is the sum of the TaskHints::cpu_cost of its nodes (a node without a cost counts as 1),
+         and TaskHints::priority is set to the rank of the node in that order, 0 for the most critical one.
+      On a ThreadPool using SchedulingPolicy::Priority, the most critical ready node then runs first
+         even when it was spawned after others, with another policy only the spawn order follows the critical path.
+      A built graph can be run any number of times, including concurrently.
+
+   Note :
+      Building the graph is not thread-safe, it must not be modified while Run() is being called.
+*/
+class ARROW_EXPORT TaskGraph
+{
+public:
+   using NodeId = int;
+
+   /*
+      Brief :
+         A node function, a failed status skips every node not started yet and becomes the result of the run.
+   */
+   using NodeFunction = std::function<Status()>;
+
+   /*
+      Brief :
+         The graph in its executable form, built on the first Run() after a modification.
+   */
+   struct Plan;
+
+   TaskGraph();
+   ~TaskGraph();
+
+   /*
+      Brief :
+         Add a node to the graph.
+
+      Return :
+         The identifier of the node, to be used with AddEdge().
+   */
+   NodeId AddNode(NodeFunction function, TaskHints hints = TaskHints{});
+
+   /*
+      Brief :
+         Declare that node `to` must only start once node `from` has finished.
+   */
+   Status AddEdge(NodeId from, NodeId to);
+
+   /*
+      Brief :
+         Return the number of nodes of the graph.
+   */
+   int GetNumNodes() const { return static_cast<int>(nodes_.size()); }
+
+   /*
+      Brief :
+         Run the graph on the given executor.
+
+      Detailed :
+         Once stop_token is triggered, nodes not started yet are skipped and the run fails with the stop status.
+
+      Return :
+         A future set once every node has run or been skipped, with the first error if any.
+         An Invalid status if the graph has a cycle.
+
+      Note :
+         Waiting on the future from a task of the same executor may deadlock it.
+   */
+   std::future<Status> Run(Executor* executor, StopToken stop_token = StopToken::Unstoppable());
+
+private:
+   struct Node
+   {
+      NodeFunction function;
+      TaskHints hints;
+      std::vector<NodeId> successors;
+   };
+
+   Status BuildPlan();
+
+   std::vector<Node> nodes_;
+
+   // Reset by every modification, runs in flight keep the plan they started with
+   std::shared_ptr<const Plan> plan_;
+   std::mutex plan_mutex_;
+};
+
+}  // namespace arrow
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "cancel.h"
+#include "functional.h"
+#include "object_pool.h"
+#include "status.h"
+#include "executor.h"
+
+namespace arrow
+{
+
+namespace internal
+{
+
+/*
+   Brief :
+      A task queued in a ThreadPool.
+*/
+struct Task
+{
+   // Task function, can only be called once. The detail of FnOnce<> please see functional.h
+   FnOnce<void()> callable;
+
+   StopToken stop_token;
+
+   // Stop requested callback function.
+   Executor::StopCallback stop_callback;
+
+   // Hints given at submission, used by the scheduling policy
+   TaskHints hints;
+
+   // Worker slot the task has affinity with, -1 if none. See KeyAffinityTaskQueue
+   int home_slot = -1;
+
+   // Index of the NUMA node the task should run on, -1 if none. See NumaTaskQueue
+   int numa_node = -1;
+
+   // When the task was queued
+   std::chrono::steady_clock::time_point enqueue_time;
+};
+
+/*
+   Brief :
+      A FIFO list of tasks, the building block of the TaskQueue implementations.
+
+   Detailed :
+      Every task is held by a record taken from an ObjectPool, and the record goes back to the pool once the task is popped.
+      Unlike a std::deque, whose blocks are allocated and freed as the queue moves forward,
+         a steady flow of tasks through the list doesn't call into the allocator.
+*/
+class ARROW_EXPORT TaskList
+{
+public:
+   TaskList() = default;
+   TaskList(TaskList&& other) noexcept;
+   TaskList& operator=(TaskList&& other) noexcept;
+   ~TaskList();
+
+   void PushBack(Task&& task);
+
+   // The list must not be empty
+   void PopFront(Task* task);
+
+   size_t Size() const { return size_; }
+   bool Empty() const { return size_ == 0; }
+
+   /*
+      Brief :
+         Move every task to the end of `tasks`, in order, the list is then empty.
+   */
+   void MoveTo(std::vector<Task>* tasks);
+
+private:
+   struct Record
+   {
+      Task task;
+      Record* next = nullptr;
+   };
+
+   void Clear();
+
+   Record* head_ = nullptr;
+   Record* tail_ = nullptr;
+   size_t size_ = 0;
+};
+
+/*
+   Brief :
+      Options, bookkeeping and statistics of a tenant of a ThreadPool, see TaskHints::tenant_id.
+*/
+struct Tenant
+{
+   int weight = 1;
+   int max_concurrency = 0;
+
+   // Number of tasks of the tenant currently running
+   int running = 0;
+
+   int64_t tasks_started = 0;
+   std::chrono::nanoseconds total_queue_time{0};
+   std::chrono::nanoseconds max_queue_time{0};
+};
+
+using TenantTable = std::unordered_map<int64_t, Tenant>;
+
+/*
+   Brief :
+      The pending tasks of a ThreadPool, the implementation decides in which order they run.
+
+   Detailed :
+      Every worker of the pool owns a slot, a small integer in [0, capacity) which stays the same while the worker lives.
+      A queue may reserve a task for the worker of a given slot, the pool then makes sure that worker is woken up.
+
+   Note :
+      Not thread-safe, all calls are made with ThreadPool::State::mutex_ held.
+*/
+class TaskQueue
+{
+public:
+   virtual ~TaskQueue() = default;
+
+   /*
+      Brief :
+         Queue a task.
+
+      Return :
+         The slot of the worker the task is reserved for, or -1 if any worker may run it.
+   */
+   virtual int Push(Task&& task) = 0;
+
+   /*
+      Brief :
+         Take the next task the worker of the given slot should run.
+
+      Return :
+         false if there is no task this worker may run.
+   */
+   virtual bool Pop(int slot, Task* task) = 0;
+
+   /*
+      Brief :
+         Return the number of queued tasks.
+   */
+   virtual size_t Size() const = 0;
+
+   bool Empty() const { return Size() == 0; }
+
+   /*
+      Brief :
+         Move every queued task out of the queue, in the order they would have run.
+   */
+   virtual std::vector<Task> TakeAll() = 0;
+
+   /*
+      Brief :
+         Inform the queue that a worker started (live == true) or stopped using the given slot.
+   */
+   virtual void SetSlotLive(int /*slot*/, bool /*live*/) {}
+};
+
+/*
+   Brief :
+      Plain FIFO order, tasks are never reserved for a worker.
+*/
+class FifoTaskQueue : public TaskQueue
+{
+public:
+   int Push(Task&& task) override;
+   bool Pop(int slot, Task* task) override;
+   size_t Size() const override { return tasks_.Size(); }
+   std::vector<Task> TakeAll() override;
+
+private:
+   TaskList tasks_;
+};
+
+/*
+   Brief :
+      Tasks sharing a TaskHints::external_id run on the same worker when possible.
+
+   Detailed :
+      A task with a home slot (see Task::home_slot) is queued on the local queue of that slot, other tasks on a shared FIFO queue.
+      A worker serves its local queue first, then the shared queue.
+      As a fallback it then serves the local queues of slots without a live worker, so that no task gets stranded,
+         and the local queue of the most backlogged worker if more than max_backlog tasks wait there.
+*/
+class KeyAffinityTaskQueue : public TaskQueue
+{
+public:
+   explicit KeyAffinityTaskQueue(int max_backlog) : max_backlog_(max_backlog) {}
+
+   int Push(Task&& task) override;
+   bool Pop(int slot, Task* task) override;
+   size_t Size() const override { return size_; }
+   std::vector<Task> TakeAll() override;
+   void SetSlotLive(int slot, bool live) override;
+
+private:
+   struct Slot
+   {
+      TaskList tasks;
+      bool live = false;
+   };
+
+   Slot& GetSlot(int slot);
+
+   int max_backlog_;
+   size_t size_ = 0;
+   TaskList shared_tasks_;
+   // A deque, as growing it must not relocate the slots
+   std::deque<Slot> slots_;
+};
+
+/*
+   Brief :
+      Earliest deadline first, tasks without a TaskHints::deadline come last. Ties are broken in FIFO order.
+*/
+class DeadlineTaskQueue : public TaskQueue
+{
+public:
+   int Push(Task&& task) override;
+   bool Pop(int slot, Task* task) override;
+   size_t Size() const override { return heap_.size(); }
+   std::vector<Task> TakeAll() override;
+
+private:
+   struct Entry
+   {
+      std::chrono::steady_clock::time_point deadline;
+      uint64_t sequence;
+      Task task;
+   };
+
+   // Orders the heap so that its front is the most urgent entry
+   static bool Later(const Entry& left, const Entry& right);
+
+   uint64_t next_sequence_ = 0;
+   std::vector<Entry> heap_;
+};
+
+/*
+   Brief :
+      Lowest TaskHints::priority first. Ties are broken in FIFO order.
+*/
+class PriorityTaskQueue : public TaskQueue
+{
+public:
+   int Push(Task&& task) override;
+   bool Pop(int slot, Task* task) override;
+   size_t Size() const override { return heap_.size(); }
+   std::vector<Task> TakeAll() override;
+
+private:
+   struct Entry
+   {
+      int32_t priority;
+      uint64_t sequence;
+      Task task;
+   };
+
+   // Orders the heap so that its front is the most urgent entry
+   static bool Later(const Entry& left, const Entry& right);
+
+   uint64_t next_sequence_ = 0;
+   std::vector<Entry> heap_;
+};
+
+/*
+   Brief :
+      Weighted fair share between tenants, with deficit round-robin.
+
+   Detailed :
+      Each tenant with queued tasks is in a round-robin list.
+      When a tenant comes to the front of the list it is credited its weight, and it is served until it runs out of credit,
+         runs out of tasks or reaches its maximum concurrency, then the next tenant is served.
+      Only tenants with queued tasks take part, so a lone tenant may use every worker.
+*/
+class FairShareTaskQueue : public TaskQueue
+{
+public:
+   // `tenants` must outlive the queue, tenants missing from it have the default options
+   explicit FairShareTaskQueue(const TenantTable* tenants) : tenants_(tenants) {}
+
+   int Push(Task&& task) override;
+   bool Pop(int slot, Task* task) override;
+   size_t Size() const override { return size_; }
+   std::vector<Task> TakeAll() override;
+
+private:
+   struct TenantQueue
+   {
+      TaskList tasks;
+      int64_t deficit = 0;
+   };
+
+   const TenantTable* tenants_;
+   size_t size_ = 0;
+   std::unordered_map<int64_t, TenantQueue> queues_;
+
+   // Tenants with queued tasks, the front one is being served
+   std::deque<int64_t> round_robin_;
+};
+
+/*
+   Brief :
+      One FIFO queue per NUMA node, workers serve the queue of their own node.
+
+   Detailed :
+      The worker of slot s belongs to node s % node_count, a task goes to the queue of Task::numa_node.
+      Only when the queue of its node is empty does a worker take a task from another node,
+         the most backlogged one, so that no task waits while a worker idles.
+*/
+class NumaTaskQueue : public TaskQueue
+{
+public:
+   explicit NumaTaskQueue(int node_count) : nodes_(node_count) {}
+
+   int Push(Task&& task) override;
+   bool Pop(int slot, Task* task) override;
+   size_t Size() const override { return size_; }
+   std::vector<Task> TakeAll() override;
+
+private:
+   size_t size_ = 0;
+   std::vector<TaskList> nodes_;
+};
+
+}  // namespace internal
+
+}  // namespace arrow
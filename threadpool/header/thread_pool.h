@@ -4,11 +4,13 @@
 #include <cstdint>
 #include <functional>
 #include <future>
+#include <map>
 #include <memory>
 #include <optional>
 #include <queue>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "cancel.h"
 #include "functional.h"
@@ -46,6 +48,61 @@ ARROW_EXPORT int GetCpuThreadPoolCapacity();
 */
 ARROW_EXPORT Status SetCpuThreadPoolCapacity(int threads);
 
+/*
+   Brief :
+      The order in which a ThreadPool runs its pending tasks.
+*/
+enum class SchedulingPolicy
+{
+   // Tasks run in submission order on whichever worker is available
+   Fifo,
+
+   // Tasks sharing a TaskHints::external_id run on the same worker when possible, to keep its caches warm
+   KeyAffinity,
+
+   // Tasks with the earliest TaskHints::deadline run first, tasks without a deadline run last in FIFO order
+   EarliestDeadline,
+
+   // Tenants (see TaskHints::tenant_id) share the workers according to their weight, each tenant's tasks run in FIFO order
+   FairShare,
+
+   /*
+      Workers are split into one sub-pool per NUMA node, worker slot s belonging to the s % node_count-th node.
+      Tasks run in FIFO order on a worker of their TaskHints::numa_node, or else of the submitting thread's node,
+         workers only take tasks of another node when their own node has none.
+      Combine with AffinityPolicy::NumaNode so that workers stay on their node, and allocate from it.
+   */
+   NumaLocal,
+
+   // Tasks with the lowest TaskHints::priority run first, ties in FIFO order. See TaskGraph, which ranks its nodes this way
+   Priority
+};
+
+/*
+   Brief :
+      Which CPUs the workers of a ThreadPool run on.
+*/
+enum class AffinityPolicy
+{
+   // Workers are not pinned, the OS scheduler moves them around
+   None,
+
+   // Each worker is pinned to one CPU, filling the hyper-threads of a core, then the cores of a package, then the next package
+   Compact,
+
+   // Each worker is pinned to one CPU, spreading the workers over as many packages and cores as possible
+   Scatter,
+
+   // Each worker is pinned to one CPU of AffinityOptions::cpus, in order
+   Explicit,
+
+   // Every worker may run on every CPU of the process cpuset, undoing any change made to a worker's affinity since
+   Inherit,
+
+   // Each worker may run on every CPU of its NUMA node, see SchedulingPolicy::NumaLocal
+   NumaNode
+};
+
 /*
    Brief : 
       An Executor implementation spawning tasks in FIFO manner on a fixed-size pool of worker threads.
@@ -63,6 +120,168 @@ public:
    */
    struct State;
 
+   /*
+      Brief :
+         How the pool orders its pending tasks.
+   */
+   struct SchedulingOptions
+   {
+      SchedulingPolicy policy = SchedulingPolicy::Fifo;
+
+      /*
+         KeyAffinity only : once more than this many tasks wait for a busy worker,
+            idle workers take tasks from its queue instead of waiting.
+      */
+      int affinity_max_backlog = 4;
+
+      /*
+         Any policy : a task whose TaskHints::deadline has passed when a worker picks it up is not run,
+            its StopCallback is invoked with a DeadlineExceeded status instead.
+      */
+      bool drop_expired = false;
+   };
+
+   /*
+      Brief :
+         How an idle worker waits for the next task, see SetWaitOptions().
+
+      Detailed :
+         An idle worker first busy-waits with a pause instruction for up to spin_limit,
+            then calls std::this_thread::yield() until yield_limit more has passed, and finally parks.
+         A task arriving during the first two phases is picked up without paying for a wakeup.
+   */
+   struct WaitOptions
+   {
+      std::chrono::nanoseconds spin_limit{0};
+      std::chrono::nanoseconds yield_limit{0};
+
+      /*
+         Scale the spin and yield phases to the recent task arrival rate :
+            workers wait about twice the mean time between submissions,
+            and park right away when tasks arrive too rarely for waiting to pay off.
+      */
+      bool adaptive = true;
+   };
+
+   /*
+      Brief :
+         Where the workers run, see SetAffinityOptions().
+
+      Note :
+         Worker slots are mapped to CPUs in order, wrapping around when there are more workers than CPUs.
+   */
+   struct AffinityOptions
+   {
+      AffinityPolicy policy = AffinityPolicy::None;
+
+      // Explicit only
+      std::vector<int> cpus;
+   };
+
+   /*
+      Brief :
+         Options of the busy-polling mode, see EnableBusyPoll().
+   */
+   struct BusyPollOptions
+   {
+      // One poller is pinned to each of these CPUs, which should be kept free of other threads (e.g. with isolcpus)
+      std::vector<int> cpus;
+
+      // Capacity of the submission queue, submissions finding it full take the regular path
+      size_t queue_capacity = 4096;
+   };
+
+   /*
+      Brief :
+         How a tenant shares the pool with the others, see SetTenantOptions().
+   */
+   struct TenantOptions
+   {
+      /*
+         FairShare only : while several tenants have tasks waiting,
+            each one gets a number of task starts proportional to its weight.
+      */
+      int weight = 1;
+
+      // FairShare only : maximum number of tasks of the tenant running at the same time, 0 for no limit
+      int max_concurrency = 0;
+   };
+
+   /*
+      Brief :
+         Statistics of one tenant.
+   */
+   struct TenantMetrics
+   {
+      // Number of tasks taken out of the queue, whether they were run or not
+      int64_t tasks_started = 0;
+
+      // Time spent in the queue by those tasks
+      std::chrono::nanoseconds total_queue_time{0};
+      std::chrono::nanoseconds max_queue_time{0};
+
+      std::chrono::nanoseconds MeanQueueTime() const
+      {
+         return tasks_started == 0 ? std::chrono::nanoseconds(0) : total_queue_time / tasks_started;
+      }
+   };
+
+   /*
+      Brief :
+         Statistics of one worker, identified by its slot. The slot of a worker is in [0, capacity).
+   */
+   struct WorkerMetrics
+   {
+      // Number of tasks run by this worker
+      int64_t tasks_executed = 0;
+
+      // Number of tasks with a TaskHints::external_id run by this worker
+      int64_t keyed_tasks_executed = 0;
+
+      // Among keyed_tasks_executed, the tasks whose external_id maps to this worker
+      int64_t affinity_hits = 0;
+
+      // Number of times this worker was unparked, and among them the times it found no task to run
+      int64_t wakeups = 0;
+      int64_t futile_wakeups = 0;
+
+      // Number of times this worker spun (see WaitOptions), and among them the times it found a task instead of parking
+      int64_t spins = 0;
+      int64_t wakeups_avoided = 0;
+
+      // Number of times this worker was seen on another CPU than for its previous task, and the CPU of its last task
+      int64_t migrations = 0;
+      int cpu = -1;
+
+      double AffinityHitRate() const
+      {
+         return keyed_tasks_executed == 0 ? 0.0 : static_cast<double>(affinity_hits) / keyed_tasks_executed;
+      }
+   };
+
+   /*
+      Brief :
+         Statistics of the pool, see GetMetrics().
+   */
+   struct Metrics
+   {
+      // Indexed by worker slot
+      std::vector<WorkerMetrics> workers;
+
+      // Number of tasks picked up by a worker after their TaskHints::deadline, whether they were run or dropped
+      int64_t deadline_misses = 0;
+
+      // Among deadline_misses, the tasks dropped because of SchedulingOptions::drop_expired
+      int64_t deadline_drops = 0;
+
+      // Number of tasks run by the pollers of the busy-polling mode
+      int64_t busy_polled_tasks = 0;
+
+      // Indexed by TaskHints::tenant_id, tasks without a tenant are accounted to tenant -1.
+      // Only tasks started under SchedulingPolicy::FairShare are accounted
+      std::map<int64_t, TenantMetrics> tenants;
+   };
+
    /*
       Brief : 
          Construct a thread pool with the given number of worker threads
@@ -117,9 +336,40 @@ public:
       Brief :
          Heuristic for the default capacity of a thread pool for CPU-bound tasks.
          This is exposed as a static method to help with testing.
+
+      Detailed :
+         OMP_NUM_THREADS wins if set, otherwise the capacity is the number of CPUs the process can keep busy :
+            the size of its cpuset, lowered to its cgroup CPU quota, so that a container doesn't get throttled.
+         OMP_THREAD_LIMIT caps the result.
    */ 
    static int DefaultCapacity();
 
+   /*
+      Brief :
+         Re-evaluate DefaultCapacity() every `period` and call SetCapacity() whenever it changes,
+            e.g. when the CPU quota of the container is updated.
+
+      Note :
+         A capacity set by hand stays until the default changes. Calling it again changes the period.
+   */
+   Status StartCapacityMonitor(std::chrono::milliseconds period);
+
+   /*
+      Brief :
+         Stop re-evaluating the default capacity, see StartCapacityMonitor().
+   */
+   Status StopCapacityMonitor();
+
+   /*
+      Brief :
+         Affinity of the global thread pool, read from the ARROW_CPU_AFFINITY environment variable.
+
+      Detailed :
+         The variable holds "none", "compact", "scatter", "inherit", "numa" or a CPU list such as "0-3,8" for an explicit policy.
+         Unset or malformed, the policy is None.
+   */
+   static AffinityOptions DefaultAffinityOptions();
+
    /*
       Brief :
          Shutdown the pool.
@@ -131,6 +381,72 @@ public:
    */
    Status Shutdown(bool wait = true);
 
+   /*
+      Brief :
+         Change how pending tasks are ordered.
+
+      Note :
+         Tasks already queued are kept and reordered according to the new policy.
+   */
+   Status SetSchedulingOptions(const SchedulingOptions& options);
+
+   /*
+      Brief :
+         Change how a tenant shares the pool with the others.
+
+      Note :
+         Tenants which were never configured have the default TenantOptions.
+   */
+   Status SetTenantOptions(int64_t tenant_id, const TenantOptions& options);
+
+   /*
+      Brief :
+         Change how idle workers wait for the next task.
+
+      Note :
+         By default they park right away, spinning trades CPU time for a lower latency on bursty traffic.
+   */
+   Status SetWaitOptions(const WaitOptions& options);
+
+   /*
+      Brief :
+         Change which CPUs the workers run on.
+
+      Note :
+         Running workers are pinned again right away, new workers when they start.
+   */
+   Status SetAffinityOptions(const AffinityOptions& options);
+
+   /*
+      Brief :
+         Switch to the busy-polling mode, for the lowest possible submit-to-start latency.
+
+      Detailed :
+         Dedicated pollers, one per CPU of options.cpus, spin on a lock-free submission queue and never sleep.
+         Submitting to that queue or taking a task from it touches neither the pool mutex nor a condition variable.
+         The regular workers stay around and take the submissions which find the queue full.
+
+      Note :
+         Tasks go to the pollers in FIFO order, the scheduling policy and the TaskHints are ignored.
+         Each poller keeps its CPU 100% busy until DisableBusyPoll() is called.
+   */
+   Status EnableBusyPoll(const BusyPollOptions& options);
+
+   /*
+      Brief :
+         Switch back to parking workers, the pollers exit once they ran every task submitted to them.
+
+      Note :
+         Must not be called from a task run by a poller.
+   */
+   Status DisableBusyPoll();
+
+   /*
+      Brief :
+         Return a snapshot of the pool statistics.
+   */
+   Metrics GetMetrics();
+
    /*
       Brief :
          Wait for the thread pool to become idle.
@@ -160,8 +476,11 @@ protected:
    /*
       Brief :
          Launch a given number of additional workers.
+
+      Note :
+         Each worker takes the lowest free slot, except the first one which takes preferred_slot if it is free.
    */
-   void LaunchWorkersUnlocked(int threads);
+   void LaunchWorkersUnlocked(int threads, int preferred_slot = -1);
 
    /*
       Brief :
@@ -1,6 +1,7 @@
 #include "cancel.h"
 
 #include <atomic>
+#include <map>
 #include <mutex>
 #include <sstream>
 #include <utility>
@@ -37,6 +38,17 @@ struct StopSourceImpl
    std::atomic<int> requested_{0};  
    std::mutex mutex_;
    Status cancel_error_;
+
+   /*
+      Brief :
+         Functions registered through StopCallbackRegistration, by registration id.
+
+      Note :
+         Held while the functions are called, so that unregistering waits for a call in progress.
+   */
+   std::mutex callbacks_mutex_;
+   std::map<uint64_t, std::function<void()>> callbacks_;
+   uint64_t next_callback_id_ = 1;
 };
 
 StopSource::StopSource() : impl_(new StopSourceImpl) {}
@@ -47,13 +59,23 @@ void StopSource::RequestStop() { RequestStop(Status::Cancelled("Operation cancel
 
 void StopSource::RequestStop(Status st) 
 {
-   std::lock_guard<std::mutex> lock(impl_->mutex_);
-   DCHECK_NOT_OK(st);
-   if ( !impl_->requested_ ) 
    {
+      std::lock_guard<std::mutex> lock(impl_->mutex_);
+      DCHECK_NOT_OK(st);
+      if ( impl_->requested_ ) 
+      {
+         return;
+      }
       impl_->requested_ = -1;
       impl_->cancel_error_ = std::move(st);
    }
+
+   // Registrations made from now on see requested_ and call their function themselves
+   std::lock_guard<std::mutex> lock(impl_->callbacks_mutex_);
+   for (auto& callback : impl_->callbacks_)
+   {
+      callback.second();
+   }
 }
 
 void StopSource::RequestStopFromSignal(int signum) 
@@ -102,4 +124,33 @@ Status StopToken::Poll() const
    return impl_->cancel_error_;
 }
 
+StopCallbackRegistration::StopCallbackRegistration(const StopToken& token, std::function<void()> callback)
+{
+   if ( !token.impl_ )
+   {
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(token.impl_->callbacks_mutex_);
+      if ( !token.impl_->requested_.load() )
+      {
+         impl_ = token.impl_;
+         id_ = impl_->next_callback_id_++;
+         impl_->callbacks_.emplace(id_, std::move(callback));
+         return;
+      }
+   }
+   callback();
+}
+
+StopCallbackRegistration::~StopCallbackRegistration()
+{
+   if ( id_ != 0 )
+   {
+      std::lock_guard<std::mutex> lock(impl_->callbacks_mutex_);
+      impl_->callbacks_.erase(id_);
+   }
+}
+
 }  // namespace arrow
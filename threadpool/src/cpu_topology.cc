@@ -0,0 +1,366 @@
+#include <dirent.h>
+#include <sched.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <tuple>
+
+#include "cpu_topology.h"
+
+namespace arrow
+{
+
+namespace internal
+{
+
+/*
+   Brief :
+      Read a file of /sys holding a single integer, return `fallback` if it cannot be read.
+*/
+static int64_t ReadSysInt(const std::string& path, int64_t fallback)
+{
+   std::ifstream file(path);
+   int64_t value;
+   if ( !(file >> value) )
+   {
+      return fallback;
+   }
+   return value;
+}
+
+std::vector<CpuInfo> GetAllowedCpus()
+{
+   std::vector<CpuInfo> cpus;
+   cpu_set_t allowed;
+   CPU_ZERO(&allowed);
+   if ( sched_getaffinity(0, sizeof(allowed), &allowed) != 0 )
+   {
+      return cpus;
+   }
+
+   for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+   {
+      if ( !CPU_ISSET(cpu, &allowed) )
+      {
+         continue;
+      }
+      const std::string topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+      CpuInfo info;
+      info.cpu = cpu;
+      info.package = static_cast<int>(ReadSysInt(topology + "physical_package_id", 0));
+      info.core = static_cast<int>(ReadSysInt(topology + "core_id", cpu));
+      cpus.push_back(info);
+   }
+   return cpus;
+}
+
+std::vector<NumaNode> GetNumaNodes()
+{
+   std::vector<NumaNode> nodes;
+   std::vector<int> allowed;
+   for (const CpuInfo& info : GetAllowedCpus())
+   {
+      allowed.push_back(info.cpu);
+   }
+
+   const std::string root = "/sys/devices/system/node/";
+   DIR* dir = opendir(root.c_str());
+   if ( dir != nullptr )
+   {
+      while ( dirent* entry = readdir(dir) )
+      {
+         const std::string name = entry->d_name;
+         if ( name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+              name.find_first_not_of("0123456789", 4) != std::string::npos )
+         {
+            continue;
+         }
+
+         std::ifstream file(root + name + "/cpulist");
+         std::string list;
+         std::getline(file, list);
+         auto cpus = ParseCpuList(list);
+         if ( !cpus.has_value() )
+         {
+            continue;
+         }
+
+         NumaNode node;
+         node.id = std::stoi(name.substr(4));
+         for (int cpu : *cpus)
+         {
+            if ( std::binary_search(allowed.begin(), allowed.end(), cpu) )
+            {
+               node.cpus.push_back(cpu);
+            }
+         }
+         if ( !node.cpus.empty() )
+         {
+            nodes.push_back(std::move(node));
+         }
+      }
+      closedir(dir);
+   }
+
+   if ( nodes.empty() )
+   {
+      NumaNode node;
+      node.cpus = std::move(allowed);
+      nodes.push_back(std::move(node));
+   }
+   std::sort(nodes.begin(), nodes.end(), [](const NumaNode& left, const NumaNode& right) { return left.id < right.id; });
+   return nodes;
+}
+
+/*
+   Brief :
+      Read the CPU limit set on a single cgroup directory, in the v2 or the v1 format.
+*/
+static std::optional<double> ReadCgroupCpuLimit(const std::string& dir)
+{
+   std::ifstream max_file(dir + "/cpu.max");
+   std::string quota;
+   int64_t period;
+   if ( max_file >> quota >> period )
+   {
+      // "max 100000" when unlimited
+      if ( quota == "max" || period <= 0 )
+      {
+         return {};
+      }
+      try
+      {
+         return std::stod(quota) / period;
+      }
+      catch (...)
+      {
+         return {};
+      }
+   }
+
+   // -1 when unlimited
+   const int64_t quota_us = ReadSysInt(dir + "/cpu.cfs_quota_us", -1);
+   const int64_t period_us = ReadSysInt(dir + "/cpu.cfs_period_us", -1);
+   if ( quota_us <= 0 || period_us <= 0 )
+   {
+      return {};
+   }
+   return static_cast<double>(quota_us) / period_us;
+}
+
+std::optional<double> GetCgroupCpuLimit()
+{
+   std::optional<double> limit;
+   const auto apply = [&](const std::string& dir)
+   {
+      auto dir_limit = ReadCgroupCpuLimit(dir);
+      if ( dir_limit.has_value() && (!limit.has_value() || *dir_limit < *limit) )
+      {
+         limit = dir_limit;
+      }
+   };
+
+   // Lines are "hierarchy-id:controllers:path", the v2 hierarchy has id 0 and no controllers
+   std::ifstream file("/proc/self/cgroup");
+   std::string line;
+   while ( std::getline(file, line) )
+   {
+      const size_t first = line.find(':');
+      const size_t second = line.find(':', first + 1);
+      if ( first == std::string::npos || second == std::string::npos )
+      {
+         continue;
+      }
+      const std::string controllers = line.substr(first + 1, second - first - 1);
+      std::string path = line.substr(second + 1);
+
+      std::vector<std::string> roots;
+      if ( controllers.empty() )
+      {
+         roots.push_back("/sys/fs/cgroup");
+      }
+      else
+      {
+         std::stringstream names(controllers);
+         std::string name;
+         bool has_cpu = false;
+         while ( std::getline(names, name, ',') )
+         {
+            has_cpu = has_cpu || name == "cpu";
+         }
+         if ( !has_cpu )
+         {
+            continue;
+         }
+         roots.push_back("/sys/fs/cgroup/" + controllers);
+         roots.push_back("/sys/fs/cgroup/cpu");
+      }
+
+      // Inside a container the path may not exist in our view of the hierarchy, its ancestors then stand for it
+      for (const auto& root : roots)
+      {
+         std::string dir = path;
+         while ( true )
+         {
+            apply(root + dir);
+            if ( dir.empty() || dir == "/" )
+            {
+               break;
+            }
+            dir = dir.substr(0, dir.find_last_of('/'));
+         }
+      }
+   }
+   return limit;
+}
+
+int GetAvailableCpuCount()
+{
+   int count = static_cast<int>(std::thread::hardware_concurrency());
+
+   cpu_set_t allowed;
+   CPU_ZERO(&allowed);
+   if ( sched_getaffinity(0, sizeof(allowed), &allowed) == 0 )
+   {
+      const int allowed_count = CPU_COUNT(&allowed);
+      count = count == 0 ? allowed_count : std::min(count, allowed_count);
+   }
+
+   auto limit = GetCgroupCpuLimit();
+   if ( limit.has_value() && count > 0 )
+   {
+      count = std::min(count, std::max(1, static_cast<int>(std::ceil(*limit))));
+   }
+   return count;
+}
+
+std::vector<int> CompactCpuOrder(std::vector<CpuInfo> cpus)
+{
+   std::sort(cpus.begin(), cpus.end(), [](const CpuInfo& left, const CpuInfo& right)
+   {
+      return std::tie(left.package, left.core, left.cpu) < std::tie(right.package, right.core, right.cpu);
+   });
+
+   std::vector<int> order;
+   for (const CpuInfo& info : cpus)
+   {
+      order.push_back(info.cpu);
+   }
+   return order;
+}
+
+std::vector<int> ScatterCpuOrder(std::vector<CpuInfo> cpus)
+{
+   std::sort(cpus.begin(), cpus.end(), [](const CpuInfo& left, const CpuInfo& right)
+   {
+      return std::tie(left.package, left.core, left.cpu) < std::tie(right.package, right.core, right.cpu);
+   });
+
+   // Rank each CPU among the hyper-threads of its core, and its core among the cores of its package
+   struct Ranked
+   {
+      int thread_rank;
+      int core_rank;
+      int package;
+      int cpu;
+   };
+   std::vector<Ranked> ranked;
+   int thread_rank = 0;
+   int core_rank = 0;
+   for (size_t i = 0; i < cpus.size(); i++)
+   {
+      if ( i > 0 && cpus[i].package != cpus[i - 1].package )
+      {
+         thread_rank = core_rank = 0;
+      }
+      else if ( i > 0 && cpus[i].core != cpus[i - 1].core )
+      {
+         thread_rank = 0;
+         core_rank++;
+      }
+      else if ( i > 0 )
+      {
+         thread_rank++;
+      }
+      ranked.push_back({thread_rank, core_rank, cpus[i].package, cpus[i].cpu});
+   }
+
+   std::sort(ranked.begin(), ranked.end(), [](const Ranked& left, const Ranked& right)
+   {
+      return std::tie(left.thread_rank, left.core_rank, left.package) <
+             std::tie(right.thread_rank, right.core_rank, right.package);
+   });
+
+   std::vector<int> order;
+   for (const Ranked& entry : ranked)
+   {
+      order.push_back(entry.cpu);
+   }
+   return order;
+}
+
+std::optional<std::vector<int>> ParseCpuList(const std::string& text)
+{
+   // Files of /sys end with a newline
+   const size_t begin = text.find_first_not_of(" \t\n");
+   if ( begin == std::string::npos )
+   {
+      return std::vector<int>();
+   }
+   const std::string list = text.substr(begin, text.find_last_not_of(" \t\n") + 1 - begin);
+
+   std::vector<int> cpus;
+   size_t pos = 0;
+   while ( pos < list.size() )
+   {
+      size_t end = list.find(',', pos);
+      if ( end == std::string::npos )
+      {
+         end = list.size();
+      }
+      const std::string range = list.substr(pos, end - pos);
+      pos = end + 1;
+
+      int first, last;
+      try
+      {
+         size_t consumed;
+         first = std::stoi(range, &consumed);
+         last = first;
+         if ( consumed < range.size() )
+         {
+            if ( range[consumed] != '-' )
+            {
+               return {};
+            }
+            const std::string rest = range.substr(consumed + 1);
+            last = std::stoi(rest, &consumed);
+            if ( consumed < rest.size() )
+            {
+               return {};
+            }
+         }
+      }
+      catch (...)
+      {
+         return {};
+      }
+
+      if ( first < 0 || last < first || last >= CPU_SETSIZE )
+      {
+         return {};
+      }
+      for (int cpu = first; cpu <= last; cpu++)
+      {
+         cpus.push_back(cpu);
+      }
+   }
+   return cpus;
+}
+
+}  // namespace internal
+
+}  // namespace arrow
@@ -0,0 +1,253 @@
+#include "object_pool.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include "../../stack_x/lock_free_stack.h"
+
+namespace arrow
+{
+
+namespace internal
+{
+
+namespace
+{
+
+constexpr size_t kSizeClasses = kPoolMaxSize / kPoolGranularity;
+
+// Number of blocks moved at once between a thread cache and the global free list
+constexpr size_t kBatchSize = 32;
+
+// A thread cache beyond this number of blocks of one class gives a batch back
+constexpr size_t kCacheCapacity = 2 * kBatchSize;
+
+// Nodes kept by each global free list, so that exchanging batches doesn't allocate either.
+// Unbounded : NewBlock() reserves them as the blocks grow
+constexpr size_t kDepotNodes = SIZE_MAX;
+
+struct FreeBlock
+{
+   FreeBlock* next;
+};
+
+struct Batch
+{
+   FreeBlock* blocks = nullptr;
+   size_t count = 0;
+};
+
+// Every task goes through these free lists, a 16-bit ABA tag could wrap while a thread is preempted
+static_assert(lock_free_stack<Batch>::free_list_tag_bits >= 32,
+              "the block pool needs a double-width compare-and-swap, build with -mcx16 on x86-64");
+
+/*
+   Brief :
+      The global free list of a size class.
+*/
+struct Depot
+{
+   lock_free_stack<Batch> batches{kDepotNodes};
+
+   // Blocks of the class obtained from the allocator
+   std::atomic<size_t> blocks{0};
+};
+
+/*
+   Brief :
+      The global free lists of every size class.
+
+   Note :
+      Never destroyed, thread caches may still flush into it after static destructors ran.
+*/
+Depot* Depots()
+{
+   static Depot* depots = new Depot[kSizeClasses];
+   return depots;
+}
+
+size_t SizeClass(size_t size)
+{
+   return (size == 0 ? 0 : (size - 1) / kPoolGranularity);
+}
+
+size_t ClassSize(size_t size_class)
+{
+   return (size_class + 1) * kPoolGranularity;
+}
+
+/*
+   Brief :
+      Allocate a block of the class when no free one is left.
+
+   Detailed :
+      Threads only hand whole batches over to the global free list (but when they exit),
+         so with a node reserved for every kBatchSize blocks, pushing a batch never allocates a node.
+*/
+void* NewBlock(size_t size_class)
+{
+   Depot& depot = Depots()[size_class];
+   if ( depot.blocks.fetch_add(1, std::memory_order_relaxed) % kBatchSize == 0 )
+   {
+      depot.batches.reserve(1);
+   }
+   return ::operator new(ClassSize(size_class));
+}
+
+// Set once the cache of the calling thread is destroyed, the thread then goes straight to the global free lists
+thread_local bool cache_destroyed = false;
+
+/*
+   Brief :
+      The free blocks of the calling thread, per size class.
+*/
+struct ThreadCache
+{
+   struct List
+   {
+      FreeBlock* head = nullptr;
+      size_t count = 0;
+   };
+
+   List lists[kSizeClasses];
+
+   ~ThreadCache()
+   {
+      FlushBatches(1);
+      cache_destroyed = true;
+   }
+
+   // Hand batches over to the global free lists for as long as a class holds at least `min_count` blocks
+   void FlushBatches(size_t min_count)
+   {
+      for (size_t size_class = 0; size_class < kSizeClasses; size_class++)
+      {
+         while ( lists[size_class].count >= min_count && lists[size_class].count != 0 )
+         {
+            Flush(size_class, kBatchSize);
+         }
+      }
+   }
+
+   // Hand up to `count` blocks of the class over to the global free list
+   void Flush(size_t size_class, size_t count)
+   {
+      List& list = lists[size_class];
+      Batch batch;
+      while ( batch.count < count && list.head != nullptr )
+      {
+         FreeBlock* block = list.head;
+         list.head = block->next;
+         block->next = batch.blocks;
+         batch.blocks = block;
+         ++batch.count;
+      }
+      list.count -= batch.count;
+      Depots()[size_class].batches.push(std::move(batch));
+   }
+
+   // Take a batch from the global free list, false if it is empty
+   bool Refill(size_t size_class)
+   {
+      Batch batch;
+      if ( !Depots()[size_class].batches.try_pop(batch) )
+      {
+         return false;
+      }
+      List& list = lists[size_class];
+      list.head = batch.blocks;
+      list.count = batch.count;
+      return true;
+   }
+};
+
+ThreadCache& LocalCache()
+{
+   static thread_local ThreadCache cache;
+   return cache;
+}
+
+}  // namespace
+
+void* PoolAllocate(size_t size)
+{
+   if ( size > kPoolMaxSize )
+   {
+      return ::operator new(size);
+   }
+   const size_t size_class = SizeClass(size);
+
+   if ( cache_destroyed )
+   {
+      Batch batch;
+      if ( !Depots()[size_class].batches.try_pop(batch) )
+      {
+         return NewBlock(size_class);
+      }
+      // Keep the first block, give the rest back
+      FreeBlock* block = batch.blocks;
+      batch.blocks = block->next;
+      if ( --batch.count != 0 )
+      {
+         Depots()[size_class].batches.push(std::move(batch));
+      }
+      return block;
+   }
+
+   ThreadCache& cache = LocalCache();
+   ThreadCache::List& list = cache.lists[size_class];
+   if ( list.head == nullptr && !cache.Refill(size_class) )
+   {
+      return NewBlock(size_class);
+   }
+   FreeBlock* block = list.head;
+   list.head = block->next;
+   --list.count;
+   return block;
+}
+
+void PoolFlushThreadCache()
+{
+   if ( !cache_destroyed )
+   {
+      // Only full batches : the global free lists then hold few batches, and so few nodes
+      LocalCache().FlushBatches(kBatchSize);
+   }
+}
+
+void PoolFree(void* block, size_t size)
+{
+   if ( block == nullptr )
+   {
+      return;
+   }
+   if ( size > kPoolMaxSize )
+   {
+      ::operator delete(block);
+      return;
+   }
+   const size_t size_class = SizeClass(size);
+   FreeBlock* free_block = static_cast<FreeBlock*>(block);
+
+   if ( cache_destroyed )
+   {
+      free_block->next = nullptr;
+      Depots()[size_class].batches.push(Batch{free_block, 1});
+      return;
+   }
+
+   ThreadCache& cache = LocalCache();
+   ThreadCache::List& list = cache.lists[size_class];
+   free_block->next = list.head;
+   list.head = free_block;
+   if ( ++list.count > kCacheCapacity )
+   {
+      cache.Flush(size_class, kBatchSize);
+   }
+}
+
+}  // namespace internal
+
+}  // namespace arrow
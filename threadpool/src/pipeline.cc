@@ -0,0 +1,405 @@
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#include "pipeline.h"
+
+namespace arrow
+{
+
+namespace
+{
+
+struct Item
+{
+   // Position of the item in the output of the previous stage
+   uint64_t sequence = 0;
+   Pipeline::Erased value;
+};
+
+/*
+   Brief :
+      A bounded blocking FIFO channel between two stages.
+
+   Detailed :
+      Close() is called by the producing side once it is done, consumers then drain the channel.
+      Cancel() drops everything and wakes every blocked producer and consumer.
+*/
+class Channel
+{
+public:
+   explicit Channel(size_t capacity) : capacity_(capacity) {}
+
+   /*
+      Return :
+         false if the channel was cancelled.
+   */
+   bool Push(Item&& item)
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_not_full_.wait(lock, [this] { return items_.size() < capacity_ || cancelled_; });
+      if ( cancelled_ )
+      {
+         return false;
+      }
+      items_.push_back(std::move(item));
+      cv_not_empty_.notify_one();
+      return true;
+   }
+
+   /*
+      Return :
+         false once the channel is closed and drained, or cancelled.
+   */
+   bool Pop(Item* item)
+   {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_not_empty_.wait(lock, [this] { return !items_.empty() || closed_ || cancelled_; });
+      if ( cancelled_ || items_.empty() )
+      {
+         return false;
+      }
+      *item = std::move(items_.front());
+      items_.pop_front();
+      cv_not_full_.notify_one();
+      return true;
+   }
+
+   void Close()
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+      cv_not_empty_.notify_all();
+   }
+
+   void Cancel()
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cancelled_ = true;
+      items_.clear();
+      cv_not_empty_.notify_all();
+      cv_not_full_.notify_all();
+   }
+
+private:
+   std::mutex mutex_;
+   std::condition_variable cv_not_full_;
+   std::condition_variable cv_not_empty_;
+   std::deque<Item> items_;
+   size_t capacity_;
+   bool closed_ = false;
+   bool cancelled_ = false;
+};
+
+/*
+   Brief :
+      Bookkeeping of one stage during a run.
+*/
+struct StageRun
+{
+   Pipeline::Stage stage;
+
+   // Channel feeding the stage
+   Channel input;
+
+   // Tasks of the stage still running, the last one closes the next channel
+   std::atomic<int> live_tasks{0};
+
+   // Serializes emission, so that the next channel receives items in sequence order
+   std::mutex emit_mutex;
+   uint64_t next_output = 0;
+
+   // preserve_order only : sequence of the next item to emit, and items done ahead of it
+   std::atomic<uint64_t> next_input{0};
+   std::map<uint64_t, Pipeline::Erased> reorder_buffer;
+
+   // preserve_order only : tasks wait here for next_input to come within `parallelism` of the item they popped
+   std::mutex order_mutex;
+   std::condition_variable order_cv;
+
+   explicit StageRun(Pipeline::Stage stage) : stage(std::move(stage)), input(this->stage.options.channel_capacity) {}
+};
+
+/*
+   Brief :
+      State of one run of a Pipeline, shared by its tasks.
+*/
+struct PipelineRun
+{
+   std::function<std::optional<Pipeline::Erased>()> source;
+   std::vector<std::unique_ptr<StageRun>> stages;
+   StopToken stop_token;
+
+   // Tasks of the run still running
+   std::atomic<int> remaining{0};
+
+   // Set once the run failed, the first error is kept
+   std::atomic<bool> failed{false};
+   std::mutex mutex;
+   Status status;
+
+   std::promise<Status> promise;
+};
+
+}  // namespace
+
+/*
+   Brief :
+      Record the first error and cancel every channel, which wakes up every task blocked on one.
+*/
+static void Fail(PipelineRun* run, const Status& status)
+{
+   {
+      std::lock_guard<std::mutex> lock(run->mutex);
+      if ( run->status.ok() )
+      {
+         run->status = status;
+      }
+   }
+   if ( !run->failed.exchange(true) )
+   {
+      for (auto& stage : run->stages)
+      {
+         stage->input.Cancel();
+         {
+            std::lock_guard<std::mutex> lock(stage->order_mutex);
+         }
+         stage->order_cv.notify_all();
+      }
+   }
+}
+
+static bool CheckStop(PipelineRun* run)
+{
+   if ( run->stop_token.IsStopRequested() )
+   {
+      Fail(run, run->stop_token.Poll());
+      return true;
+   }
+   return run->failed.load(std::memory_order_acquire);
+}
+
+static void TaskDone(const std::shared_ptr<PipelineRun>& run)
+{
+   if ( run->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1 )
+   {
+      std::lock_guard<std::mutex> lock(run->mutex);
+      run->promise.set_value(run->status);
+   }
+}
+
+/*
+   Brief :
+      Call a stage or source function, turning an exception into a failure of the run.
+*/
+template <typename Function>
+static bool Guard(PipelineRun* run, Function&& function)
+{
+   try
+   {
+      function();
+      return true;
+   }
+   catch (const std::exception& e)
+   {
+      Fail(run, Status::Invalid(std::string("pipeline stage threw an exception: ") + e.what()));
+   }
+   catch (...)
+   {
+      Fail(run, Status::Invalid("pipeline stage threw an exception"));
+   }
+   return false;
+}
+
+/*
+   Brief :
+      Hand an item processed by the given stage to what comes next, with StageRun::emit_mutex held.
+*/
+static bool DeliverUnlocked(PipelineRun* run, size_t index, Pipeline::Erased value)
+{
+   StageRun& stage = *run->stages[index];
+   if ( stage.stage.sink )
+   {
+      // An ordered sink is called here, in order, instead of by the task which popped the item
+      return !stage.stage.options.preserve_order || Guard(run, [&] { stage.stage.process(std::move(value)); });
+   }
+   return run->stages[index + 1]->input.Push(Item{stage.next_output++, std::move(value)});
+}
+
+static bool Emit(PipelineRun* run, size_t index, uint64_t sequence, Pipeline::Erased value)
+{
+   StageRun& stage = *run->stages[index];
+   std::lock_guard<std::mutex> lock(stage.emit_mutex);
+   if ( !stage.stage.options.preserve_order )
+   {
+      return DeliverUnlocked(run, index, std::move(value));
+   }
+
+   // WaitTurn() keeps every item within `parallelism` of next_input, so the buffer holds less than `parallelism` of them
+   stage.reorder_buffer.emplace(sequence, std::move(value));
+   const uint64_t first_input = stage.next_input.load(std::memory_order_relaxed);
+   bool delivered = true;
+   while ( delivered && !stage.reorder_buffer.empty() &&
+           stage.reorder_buffer.begin()->first == stage.next_input.load(std::memory_order_relaxed) )
+   {
+      Pipeline::Erased next = std::move(stage.reorder_buffer.begin()->second);
+      stage.reorder_buffer.erase(stage.reorder_buffer.begin());
+      stage.next_input.fetch_add(1, std::memory_order_release);
+      delivered = DeliverUnlocked(run, index, std::move(next));
+   }
+   if ( stage.next_input.load(std::memory_order_relaxed) != first_input )
+   {
+      {
+         std::lock_guard<std::mutex> lock(stage.order_mutex);
+      }
+      stage.order_cv.notify_all();
+   }
+   return delivered;
+}
+
+/*
+   Brief :
+      preserve_order only : wait until the item popped with the given sequence is within `parallelism` of the next one to emit.
+
+   Detailed :
+      Without it, the tasks of a stage would keep popping and processing items behind a slow one, piling them up in the reorder buffer.
+
+   Return :
+      false if the run failed meanwhile.
+*/
+static bool WaitTurn(PipelineRun* run, StageRun& stage, uint64_t sequence)
+{
+   const uint64_t window = static_cast<uint64_t>(stage.stage.options.parallelism);
+   std::unique_lock<std::mutex> lock(stage.order_mutex);
+   stage.order_cv.wait(lock, [&]
+   {
+      return sequence - stage.next_input.load(std::memory_order_acquire) < window || run->failed.load(std::memory_order_acquire);
+   });
+   return !run->failed.load(std::memory_order_acquire);
+}
+
+static void SourceLoop(std::shared_ptr<PipelineRun> run)
+{
+   Channel& output = run->stages.front()->input;
+   uint64_t sequence = 0;
+   while ( !CheckStop(run.get()) )
+   {
+      std::optional<Pipeline::Erased> item;
+      if ( !Guard(run.get(), [&] { item = run->source(); }) || !item.has_value() )
+      {
+         break;
+      }
+      if ( !output.Push(Item{sequence++, *std::move(item)}) )
+      {
+         break;
+      }
+   }
+   output.Close();
+   TaskDone(run);
+}
+
+static void StageLoop(std::shared_ptr<PipelineRun> run, size_t index)
+{
+   StageRun& stage = *run->stages[index];
+   const bool preserve_order = stage.stage.options.preserve_order;
+   const bool deferred_sink = stage.stage.sink && preserve_order;
+   Item item;
+   while ( stage.input.Pop(&item) && !CheckStop(run.get()) )
+   {
+      if ( preserve_order && !WaitTurn(run.get(), stage, item.sequence) )
+      {
+         break;
+      }
+      Pipeline::Erased value = std::move(item.value);
+      if ( !deferred_sink && !Guard(run.get(), [&] { value = stage.stage.process(std::move(value)); }) )
+      {
+         break;
+      }
+      if ( !Emit(run.get(), index, item.sequence, std::move(value)) )
+      {
+         break;
+      }
+   }
+
+   if ( stage.live_tasks.fetch_sub(1, std::memory_order_acq_rel) == 1 && index + 1 < run->stages.size() )
+   {
+      run->stages[index + 1]->input.Close();
+   }
+   TaskDone(run);
+}
+
+int Pipeline::GetTotalParallelism() const
+{
+   int total = 1;
+   for (const auto& stage : stages_)
+   {
+      total += stage.options.parallelism;
+   }
+   return total;
+}
+
+std::future<Status> Pipeline::Run(ThreadPool* pool, StopToken stop_token)
+{
+   auto run = std::make_shared<PipelineRun>();
+   std::future<Status> future = run->promise.get_future();
+
+   Status status;
+   if ( pool == nullptr )
+   {
+      status = Status::Invalid("cannot run a pipeline without a thread pool");
+   }
+   else if ( pool->GetCapacity() < GetTotalParallelism() )
+   {
+      status = Status::Invalid("thread pool capacity " + std::to_string(pool->GetCapacity()) +
+                               " is below the pipeline parallelism " + std::to_string(GetTotalParallelism()));
+   }
+   for (const auto& stage : stages_)
+   {
+      if ( stage.options.parallelism <= 0 || stage.options.channel_capacity == 0 )
+      {
+         status = Status::Invalid("pipeline stages need a parallelism and a channel capacity > 0");
+      }
+   }
+   if ( !status.ok() )
+   {
+      run->promise.set_value(status);
+      return future;
+   }
+
+   run->source = source_;
+   run->stop_token = std::move(stop_token);
+   for (const auto& stage : stages_)
+   {
+      run->stages.push_back(std::make_unique<StageRun>(stage));
+      run->stages.back()->live_tasks.store(stage.options.parallelism, std::memory_order_relaxed);
+   }
+
+   // Count every task upfront, so that the run cannot complete before all of them are spawned
+   const int total = GetTotalParallelism();
+   run->remaining.store(total, std::memory_order_relaxed);
+   int spawned = 0;
+   status = pool->Spawn([run]() { SourceLoop(run); });
+   spawned += status.ok() ? 1 : 0;
+   for (size_t index = 0; status.ok() && index < run->stages.size(); index++)
+   {
+      for (int i = 0; status.ok() && i < run->stages[index]->stage.options.parallelism; i++)
+      {
+         status = pool->Spawn([run, index]() { StageLoop(run, index); });
+         spawned += status.ok() ? 1 : 0;
+      }
+   }
+   if ( !status.ok() )
+   {
+      // The tasks already spawned exit on the cancelled channels
+      Fail(run.get(), status);
+      for (; spawned < total; spawned++)
+      {
+         TaskDone(run);
+      }
+   }
+   return future;
+}
+
+}  // namespace arrow
@@ -0,0 +1,227 @@
+#include <atomic>
+#include <thread>
+
+#include "serial_executor.h"
+#include "macros.h"
+
+namespace arrow
+{
+
+namespace
+{
+
+struct SerialTask
+{
+   // Link to the next task of the strand, written by the producer which enqueued it
+   std::atomic<SerialTask*> next{nullptr};
+
+   // Task function, can only be called once. The detail of FnOnce<> please see functional.h
+   internal::FnOnce<void()> callable;
+
+   StopToken stop_token;
+
+   // Stop requested callback function.
+   Executor::StopCallback stop_callback;
+};
+
+}  // namespace
+
+/*
+   Brief :
+      The strand's queue is an intrusive multi-producer/single-consumer linked list (Vyukov's algorithm).
+
+   Detailed :
+      Producers exchange head_ with their task and then link the previous head to it.
+      The only consumer is the drain task in flight, which owns tail_, a stub whose task was already taken.
+      tasks_queued_or_running_ is incremented after a task is linked, its 0 -> 1 transition schedules the drain task
+         and its 1 -> 0 transition ends it, so there is never more than one drain task.
+*/
+struct SerialExecutor::State
+{
+   explicit State(Executor* executor) : executor_(executor), head_(new SerialTask), tail_(head_.load()) {}
+
+   ~State()
+   {
+      // Only reached once no drain task is in flight, free whatever the underlying executor dropped
+      while ( tail_ != nullptr )
+      {
+         SerialTask* next = tail_->next.load(std::memory_order_acquire);
+         delete tail_;
+         tail_ = next;
+      }
+   }
+
+   void Push(SerialTask* task)
+   {
+      task->next.store(nullptr, std::memory_order_relaxed);
+      SerialTask* prev = head_.exchange(task, std::memory_order_acq_rel);
+      prev->next.store(task, std::memory_order_release);
+   }
+
+   /*
+      Brief :
+         Take the oldest task of the queue, the caller must know from tasks_queued_or_running_ that one exists.
+
+      Note :
+         A producer may have exchanged head_ but not linked its task yet, this window is a couple of instructions wide.
+   */
+   SerialTask* Pop()
+   {
+      SerialTask* tail = tail_;
+      SerialTask* next = tail->next.load(std::memory_order_acquire);
+      while ( next == nullptr )
+      {
+         std::this_thread::yield();
+         next = tail->next.load(std::memory_order_acquire);
+      }
+      tail_ = next;
+      delete tail;
+      return next;
+   }
+
+   Executor* executor_;
+
+   // Producers side
+   alignas(64) std::atomic<SerialTask*> head_;
+
+   // Consumer side, only touched by the drain task in flight
+   alignas(64) SerialTask* tail_;
+
+   // Total number of tasks that are either queued or running
+   alignas(64) std::atomic<int64_t> tasks_queued_or_running_{0};
+};
+
+// The strand whose drain task is running on this thread, if any
+thread_local const SerialExecutor::State* current_serial_state_ = nullptr;
+
+static Status ScheduleDrain(std::shared_ptr<SerialExecutor::State> state, TaskHints hints);
+
+/*
+   Brief :
+      Invoke the stop callback of every queued task with the given status, until the strand is empty.
+
+   Note :
+      Must be called by the owner of the consumer side.
+*/
+static void CancelPending(SerialExecutor::State* state, const Status& status)
+{
+   do
+   {
+      SerialTask* task = state->Pop();
+      auto callable = std::move(task->callable);
+      auto stop_callback = std::move(task->stop_callback);
+      if ( stop_callback )
+      {
+         std::move(stop_callback)(status);
+      }
+   } while ( state->tasks_queued_or_running_.fetch_sub(1, std::memory_order_acq_rel) != 1 );
+}
+
+/*
+   Brief :
+      Body of the drain task, run the strand's tasks one after the other.
+*/
+static void DrainLoop(std::shared_ptr<SerialExecutor::State> state, TaskHints hints)
+{
+   const SerialExecutor::State* previous_state = current_serial_state_;
+   current_serial_state_ = state.get();
+
+   for (int i = 0; i < SerialExecutor::kMaxBatchSize; i++)
+   {
+      {
+         SerialTask* task = state->Pop();
+         auto callable = std::move(task->callable);
+         auto stop_token = std::move(task->stop_token);
+         auto stop_callback = std::move(task->stop_callback);
+
+         if ( !callable )
+         {
+            // Withdrawn by its SpawnReal call, which already returned the error to the caller
+         }
+         // Check if there is a request to stop this task
+         else if ( !stop_token.IsStopRequested() )
+         {
+            std::move(callable)();
+         }
+         else if ( stop_callback )
+         {
+            std::move(stop_callback)(stop_token.Poll());
+         }
+         // Release resources before publishing the task as finished
+      }
+
+      if ( state->tasks_queued_or_running_.fetch_sub(1, std::memory_order_acq_rel) == 1 )
+      {
+         current_serial_state_ = previous_state;
+         return;
+      }
+   }
+
+   // More tasks are pending, give other users of the underlying executor a chance to run first
+   current_serial_state_ = previous_state;
+   Status status = ScheduleDrain(state, hints);
+   if ( !status.ok() )
+   {
+      CancelPending(state.get(), status);
+   }
+}
+
+static Status ScheduleDrain(std::shared_ptr<SerialExecutor::State> state, TaskHints hints)
+{
+   Executor* executor = state->executor_;
+   return executor->SpawnReal(hints, [state = std::move(state), hints]() { DrainLoop(state, hints); },
+                              StopToken::Unstoppable(), Executor::StopCallback{});
+}
+
+SerialExecutor::SerialExecutor(Executor* executor) :
+   sp_state_(std::make_shared<SerialExecutor::State>(executor)),
+   state_(sp_state_.get())
+{
+}
+
+SerialExecutor::~SerialExecutor() = default;
+
+std::optional<std::shared_ptr<SerialExecutor>> SerialExecutor::Make(Executor* executor)
+{
+   if ( executor == nullptr )
+   {
+      return {};
+   }
+   return std::shared_ptr<SerialExecutor>(new SerialExecutor(executor));
+}
+
+int SerialExecutor::GetNumTasks()
+{
+   return static_cast<int>(state_->tasks_queued_or_running_.load(std::memory_order_acquire));
+}
+
+bool SerialExecutor::OwnsThisThread() { return current_serial_state_ == state_; }
+
+Status SerialExecutor::SpawnReal(TaskHints hints, internal::FnOnce<void()> task, StopToken stop_token, StopCallback&& stop_callback)
+{
+   auto serial_task = new SerialTask;
+   serial_task->callable = std::move(task);
+   serial_task->stop_token = std::move(stop_token);
+   serial_task->stop_callback = std::move(stop_callback);
+   state_->Push(serial_task);
+
+   // Only the submission finding the strand idle schedules a drain task
+   if ( state_->tasks_queued_or_running_.fetch_add(1, std::memory_order_acq_rel) == 0 )
+   {
+      Status status = ScheduleDrain(sp_state_, hints);
+      if ( !status.ok() )
+      {
+         // The caller gets the error, so this task must neither run nor fail through its stop callback.
+         // No drain task exists, nothing else touches the task before the strand is empty again
+         auto callable = std::move(serial_task->callable);
+         auto withdrawn_callback = std::move(serial_task->stop_callback);
+
+         // We own the consumer side, the other tasks' spawns returned OK and only they get their callbacks
+         CancelPending(state_, status);
+         return status;
+      }
+   }
+   return Status::OK();
+}
+
+}  // namespace arrow
@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <atomic>
+
+#include "task_graph.h"
+
+namespace arrow
+{
+
+struct TaskGraph::Plan
+{
+   struct Node
+   {
+      NodeFunction function;
+
+      // The priority is the rank of the node in critical path order
+      TaskHints hints;
+
+      // Sorted by decreasing critical path
+      std::vector<NodeId> successors;
+
+      int predecessors = 0;
+
+      // Cost of the longest path starting at this node
+      int64_t critical_path = 0;
+   };
+
+   std::vector<Node> nodes;
+
+   // Nodes without predecessors, sorted by decreasing critical path
+   std::vector<NodeId> roots;
+};
+
+namespace
+{
+
+/*
+   Brief :
+      State of one execution of a TaskGraph, shared by its tasks in flight.
+*/
+struct GraphRun
+{
+   GraphRun(std::shared_ptr<const TaskGraph::Plan> plan, Executor* executor, StopToken stop_token) :
+      plan(std::move(plan)),
+      executor(executor),
+      stop_token(std::move(stop_token)),
+      pending(new std::atomic<int>[this->plan->nodes.size()]),
+      remaining(static_cast<int>(this->plan->nodes.size()))
+   {
+      for (size_t i = 0; i < this->plan->nodes.size(); i++)
+      {
+         pending[i].store(this->plan->nodes[i].predecessors, std::memory_order_relaxed);
+      }
+   }
+
+   std::shared_ptr<const TaskGraph::Plan> plan;
+   Executor* executor;
+   StopToken stop_token;
+
+   // Number of unfinished predecessors of each node
+   std::unique_ptr<std::atomic<int>[]> pending;
+
+   // Number of nodes which have neither run nor been skipped
+   std::atomic<int> remaining;
+
+   // Set once a node failed or the run was stopped, the first error is kept
+   std::atomic<bool> failed{false};
+   std::mutex mutex;
+   Status status;
+
+   std::promise<Status> promise;
+};
+
+}  // namespace
+
+static void Fail(GraphRun* run, const Status& status)
+{
+   std::lock_guard<std::mutex> lock(run->mutex);
+   if ( run->status.ok() )
+   {
+      run->status = status;
+   }
+   run->failed.store(true, std::memory_order_release);
+}
+
+static bool Launch(const std::shared_ptr<GraphRun>& run, TaskGraph::NodeId node);
+
+/*
+   Brief :
+      Account for a node which has run or been skipped, and launch the successors it was the last one to wait for.
+
+   Note :
+      Successors which cannot be launched are skipped right here, with a work list rather than recursion
+         so that long chains don't overflow the stack.
+*/
+static void Finish(const std::shared_ptr<GraphRun>& run, TaskGraph::NodeId node)
+{
+   std::vector<TaskGraph::NodeId> finished{node};
+   while ( !finished.empty() )
+   {
+      const TaskGraph::NodeId current = finished.back();
+      finished.pop_back();
+
+      for (TaskGraph::NodeId successor : run->plan->nodes[current].successors)
+      {
+         if ( run->pending[successor].fetch_sub(1, std::memory_order_acq_rel) == 1 && !Launch(run, successor) )
+         {
+            finished.push_back(successor);
+         }
+      }
+
+      if ( run->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1 )
+      {
+         std::lock_guard<std::mutex> lock(run->mutex);
+         run->promise.set_value(run->status);
+      }
+   }
+}
+
+static void RunNode(const std::shared_ptr<GraphRun>& run, TaskGraph::NodeId node)
+{
+   if ( !run->failed.load(std::memory_order_acquire) )
+   {
+      Status status;
+      try
+      {
+         status = run->plan->nodes[node].function();
+      }
+      catch (...)
+      {
+         status = Status::Invalid("task graph node threw an exception");
+      }
+
+      if ( !status.ok() )
+      {
+         Fail(run.get(), status);
+      }
+   }
+   Finish(run, node);
+}
+
+/*
+   Brief :
+      Spawn a node whose predecessors have all finished.
+
+   Return :
+      false if the node is skipped instead, the caller must then finish it.
+*/
+static bool Launch(const std::shared_ptr<GraphRun>& run, TaskGraph::NodeId node)
+{
+   if ( run->failed.load(std::memory_order_acquire) )
+   {
+      return false;
+   }
+
+   if ( run->stop_token.IsStopRequested() )
+   {
+      Fail(run.get(), run->stop_token.Poll());
+      return false;
+   }
+
+   Status status = run->executor->SpawnReal(run->plan->nodes[node].hints,
+                                            [run, node]() { RunNode(run, node); },
+                                            run->stop_token,
+                                            [run, node](const Status& stop_status)
+                                            {
+                                               Fail(run.get(), stop_status);
+                                               Finish(run, node);
+                                            });
+   if ( !status.ok() )
+   {
+      Fail(run.get(), status);
+      return false;
+   }
+   return true;
+}
+
+TaskGraph::TaskGraph() = default;
+
+TaskGraph::~TaskGraph() = default;
+
+TaskGraph::NodeId TaskGraph::AddNode(NodeFunction function, TaskHints hints)
+{
+   nodes_.push_back(Node{std::move(function), hints, {}});
+   plan_.reset();
+   return static_cast<NodeId>(nodes_.size() - 1);
+}
+
+Status TaskGraph::AddEdge(NodeId from, NodeId to)
+{
+   if ( from < 0 || from >= GetNumNodes() || to < 0 || to >= GetNumNodes() )
+   {
+      return Status::Invalid("unknown task graph node");
+   }
+
+   if ( from == to )
+   {
+      return Status::Invalid("a task graph node cannot depend on itself");
+   }
+
+   nodes_[from].successors.push_back(to);
+   plan_.reset();
+   return Status::OK();
+}
+
+Status TaskGraph::BuildPlan()
+{
+   auto plan = std::make_shared<Plan>();
+   const size_t size = nodes_.size();
+   plan->nodes.resize(size);
+   for (size_t i = 0; i < size; i++)
+   {
+      plan->nodes[i].function = nodes_[i].function;
+      plan->nodes[i].hints = nodes_[i].hints;
+      plan->nodes[i].successors = nodes_[i].successors;
+      for (NodeId successor : nodes_[i].successors)
+      {
+         ++plan->nodes[successor].predecessors;
+      }
+   }
+
+   // Topological order (Kahn's algorithm), which also detects cycles
+   std::vector<NodeId> order;
+   std::vector<int> pending(size);
+   for (size_t i = 0; i < size; i++)
+   {
+      pending[i] = plan->nodes[i].predecessors;
+      if ( pending[i] == 0 )
+      {
+         order.push_back(static_cast<NodeId>(i));
+      }
+   }
+   for (size_t i = 0; i < order.size(); i++)
+   {
+      for (NodeId successor : plan->nodes[order[i]].successors)
+      {
+         if ( --pending[successor] == 0 )
+         {
+            order.push_back(successor);
+         }
+      }
+   }
+   if ( order.size() != size )
+   {
+      return Status::Invalid("task graph has a cycle");
+   }
+
+   // Longest path to a sink, in reverse topological order
+   for (auto it = order.rbegin(); it != order.rend(); ++it)
+   {
+      Plan::Node& node = plan->nodes[*it];
+      int64_t longest = 0;
+      for (NodeId successor : node.successors)
+      {
+         longest = std::max(longest, plan->nodes[successor].critical_path);
+      }
+      node.critical_path = std::max<int64_t>(node.hints.cpu_cost, 1) + longest;
+   }
+
+   const auto more_critical = [&plan](NodeId left, NodeId right)
+   {
+      return plan->nodes[left].critical_path > plan->nodes[right].critical_path;
+   };
+
+   std::vector<NodeId> ranking = order;
+   std::stable_sort(ranking.begin(), ranking.end(), more_critical);
+   for (size_t rank = 0; rank < ranking.size(); rank++)
+   {
+      plan->nodes[ranking[rank]].hints.priority = static_cast<int32_t>(rank);
+   }
+
+   for (auto& node : plan->nodes)
+   {
+      std::stable_sort(node.successors.begin(), node.successors.end(), more_critical);
+   }
+   for (NodeId id : ranking)
+   {
+      if ( plan->nodes[id].predecessors == 0 )
+      {
+         plan->roots.push_back(id);
+      }
+   }
+
+   plan_ = std::move(plan);
+   return Status::OK();
+}
+
+std::future<Status> TaskGraph::Run(Executor* executor, StopToken stop_token)
+{
+   if ( executor == nullptr )
+   {
+      std::promise<Status> promise;
+      promise.set_value(Status::Invalid("cannot run a task graph without an executor"));
+      return promise.get_future();
+   }
+
+   std::shared_ptr<const Plan> plan;
+   {
+      std::lock_guard<std::mutex> lock(plan_mutex_);
+      if ( plan_ == nullptr )
+      {
+         Status status = BuildPlan();
+         if ( !status.ok() )
+         {
+            std::promise<Status> promise;
+            promise.set_value(status);
+            return promise.get_future();
+         }
+      }
+      plan = plan_;
+   }
+
+   auto run = std::make_shared<GraphRun>(std::move(plan), executor, std::move(stop_token));
+   std::future<Status> future = run->promise.get_future();
+   if ( run->plan->nodes.empty() )
+   {
+      run->promise.set_value(Status::OK());
+      return future;
+   }
+
+   for (NodeId root : run->plan->roots)
+   {
+      if ( !Launch(run, root) )
+      {
+         Finish(run, root);
+      }
+   }
+   return future;
+}
+
+}  // namespace arrow
@@ -0,0 +1,413 @@
+#include <algorithm>
+
+#include "task_queue.h"
+
+namespace arrow
+{
+
+namespace internal
+{
+
+// ----------------------------------------------------------------------
+// TaskList
+
+TaskList::TaskList(TaskList&& other) noexcept
+   : head_(other.head_), tail_(other.tail_), size_(other.size_)
+{
+   other.head_ = other.tail_ = nullptr;
+   other.size_ = 0;
+}
+
+TaskList& TaskList::operator=(TaskList&& other) noexcept
+{
+   if ( this != &other )
+   {
+      Clear();
+      head_ = other.head_;
+      tail_ = other.tail_;
+      size_ = other.size_;
+      other.head_ = other.tail_ = nullptr;
+      other.size_ = 0;
+   }
+   return *this;
+}
+
+TaskList::~TaskList()
+{
+   Clear();
+}
+
+void TaskList::Clear()
+{
+   while ( head_ != nullptr )
+   {
+      Record* next = head_->next;
+      ObjectPool<Record>::Delete(head_);
+      head_ = next;
+   }
+   tail_ = nullptr;
+   size_ = 0;
+}
+
+void TaskList::PushBack(Task&& task)
+{
+   Record* record = ObjectPool<Record>::New();
+   record->task = std::move(task);
+   if ( tail_ == nullptr )
+   {
+      head_ = record;
+   }
+   else
+   {
+      tail_->next = record;
+   }
+   tail_ = record;
+   ++size_;
+}
+
+void TaskList::PopFront(Task* task)
+{
+   Record* record = head_;
+   *task = std::move(record->task);
+   head_ = record->next;
+   if ( head_ == nullptr )
+   {
+      tail_ = nullptr;
+   }
+   --size_;
+   ObjectPool<Record>::Delete(record);
+}
+
+void TaskList::MoveTo(std::vector<Task>* tasks)
+{
+   tasks->reserve(tasks->size() + size_);
+   for (Record* record = head_; record != nullptr; record = record->next)
+   {
+      tasks->push_back(std::move(record->task));
+   }
+   Clear();
+}
+
+// ----------------------------------------------------------------------
+// FifoTaskQueue
+
+int FifoTaskQueue::Push(Task&& task)
+{
+   tasks_.PushBack(std::move(task));
+   return -1;
+}
+
+bool FifoTaskQueue::Pop(int /*slot*/, Task* task)
+{
+   if ( tasks_.Empty() )
+   {
+      return false;
+   }
+   tasks_.PopFront(task);
+   return true;
+}
+
+std::vector<Task> FifoTaskQueue::TakeAll()
+{
+   std::vector<Task> tasks;
+   tasks_.MoveTo(&tasks);
+   return tasks;
+}
+
+// ----------------------------------------------------------------------
+// KeyAffinityTaskQueue
+
+KeyAffinityTaskQueue::Slot& KeyAffinityTaskQueue::GetSlot(int slot)
+{
+   if ( static_cast<size_t>(slot) >= slots_.size() )
+   {
+      slots_.resize(slot + 1);
+   }
+   return slots_[slot];
+}
+
+int KeyAffinityTaskQueue::Push(Task&& task)
+{
+   ++size_;
+   if ( task.home_slot < 0 )
+   {
+      shared_tasks_.PushBack(std::move(task));
+      return -1;
+   }
+
+   Slot& slot = GetSlot(task.home_slot);
+   const int home_slot = task.home_slot;
+   slot.tasks.PushBack(std::move(task));
+
+   // Once the worker is backlogged, any idle worker may take its tasks
+   return static_cast<int>(slot.tasks.Size()) > max_backlog_ ? -1 : home_slot;
+}
+
+bool KeyAffinityTaskQueue::Pop(int slot, Task* task)
+{
+   TaskList* source = nullptr;
+   if ( slot >= 0 && static_cast<size_t>(slot) < slots_.size() && !slots_[slot].tasks.Empty() )
+   {
+      source = &slots_[slot].tasks;
+   }
+   else if ( !shared_tasks_.Empty() )
+   {
+      source = &shared_tasks_;
+   }
+   else
+   {
+      // Load-aware fallback: take over tasks stranded on a slot nobody serves,
+      // or else help the most backlogged worker
+      size_t backlog = static_cast<size_t>(max_backlog_);
+      for (auto& other : slots_)
+      {
+         if ( !other.tasks.Empty() && (!other.live || other.tasks.Size() > backlog) )
+         {
+            source = &other.tasks;
+            if ( !other.live )
+            {
+               break;
+            }
+            backlog = other.tasks.Size();
+         }
+      }
+   }
+
+   if ( source == nullptr )
+   {
+      return false;
+   }
+   source->PopFront(task);
+   --size_;
+   return true;
+}
+
+std::vector<Task> KeyAffinityTaskQueue::TakeAll()
+{
+   std::vector<Task> tasks;
+   tasks.reserve(size_);
+   for (auto& slot : slots_)
+   {
+      slot.tasks.MoveTo(&tasks);
+   }
+   shared_tasks_.MoveTo(&tasks);
+   size_ = 0;
+   return tasks;
+}
+
+void KeyAffinityTaskQueue::SetSlotLive(int slot, bool live)
+{
+   GetSlot(slot).live = live;
+}
+
+// ----------------------------------------------------------------------
+// DeadlineTaskQueue
+
+bool DeadlineTaskQueue::Later(const Entry& left, const Entry& right)
+{
+   if ( left.deadline != right.deadline )
+   {
+      return left.deadline > right.deadline;
+   }
+   return left.sequence > right.sequence;
+}
+
+int DeadlineTaskQueue::Push(Task&& task)
+{
+   auto deadline = task.hints.deadline.value_or(std::chrono::steady_clock::time_point::max());
+   heap_.push_back({deadline, next_sequence_++, std::move(task)});
+   std::push_heap(heap_.begin(), heap_.end(), Later);
+   return -1;
+}
+
+bool DeadlineTaskQueue::Pop(int /*slot*/, Task* task)
+{
+   if ( heap_.empty() )
+   {
+      return false;
+   }
+   std::pop_heap(heap_.begin(), heap_.end(), Later);
+   *task = std::move(heap_.back().task);
+   heap_.pop_back();
+   return true;
+}
+
+std::vector<Task> DeadlineTaskQueue::TakeAll()
+{
+   std::sort(heap_.begin(), heap_.end(), [](const Entry& left, const Entry& right) { return Later(right, left); });
+   std::vector<Task> tasks;
+   tasks.reserve(heap_.size());
+   for (auto& entry : heap_)
+   {
+      tasks.push_back(std::move(entry.task));
+   }
+   heap_.clear();
+   return tasks;
+}
+
+// ----------------------------------------------------------------------
+// PriorityTaskQueue
+
+bool PriorityTaskQueue::Later(const Entry& left, const Entry& right)
+{
+   if ( left.priority != right.priority )
+   {
+      return left.priority > right.priority;
+   }
+   return left.sequence > right.sequence;
+}
+
+int PriorityTaskQueue::Push(Task&& task)
+{
+   const int32_t priority = task.hints.priority;
+   heap_.push_back({priority, next_sequence_++, std::move(task)});
+   std::push_heap(heap_.begin(), heap_.end(), Later);
+   return -1;
+}
+
+bool PriorityTaskQueue::Pop(int /*slot*/, Task* task)
+{
+   if ( heap_.empty() )
+   {
+      return false;
+   }
+   std::pop_heap(heap_.begin(), heap_.end(), Later);
+   *task = std::move(heap_.back().task);
+   heap_.pop_back();
+   return true;
+}
+
+std::vector<Task> PriorityTaskQueue::TakeAll()
+{
+   std::sort(heap_.begin(), heap_.end(), [](const Entry& left, const Entry& right) { return Later(right, left); });
+   std::vector<Task> tasks;
+   tasks.reserve(heap_.size());
+   for (auto& entry : heap_)
+   {
+      tasks.push_back(std::move(entry.task));
+   }
+   heap_.clear();
+   return tasks;
+}
+
+// ----------------------------------------------------------------------
+// FairShareTaskQueue
+
+int FairShareTaskQueue::Push(Task&& task)
+{
+   ++size_;
+   const int64_t tenant_id = task.hints.tenant_id;
+   TenantQueue& queue = queues_[tenant_id];
+   if ( queue.tasks.Empty() )
+   {
+      round_robin_.push_back(tenant_id);
+   }
+   queue.tasks.PushBack(std::move(task));
+   return -1;
+}
+
+bool FairShareTaskQueue::Pop(int /*slot*/, Task* task)
+{
+   static const Tenant kDefaultTenant;
+
+   // Tenants at their maximum concurrency are skipped, they keep their credit
+   for (size_t skipped = 0; skipped < round_robin_.size(); skipped++)
+   {
+      const int64_t tenant_id = round_robin_.front();
+      auto it = tenants_->find(tenant_id);
+      const Tenant& tenant = it == tenants_->end() ? kDefaultTenant : it->second;
+      TenantQueue& queue = queues_[tenant_id];
+
+      if ( tenant.max_concurrency > 0 && tenant.running >= tenant.max_concurrency )
+      {
+         round_robin_.push_back(tenant_id);
+         round_robin_.pop_front();
+         continue;
+      }
+
+      // The tenant's turn starts
+      if ( queue.deficit <= 0 )
+      {
+         queue.deficit += tenant.weight;
+      }
+
+      queue.tasks.PopFront(task);
+      --queue.deficit;
+      --size_;
+
+      if ( queue.tasks.Empty() )
+      {
+         queues_.erase(tenant_id);
+         round_robin_.pop_front();
+      }
+      else if ( queue.deficit <= 0 )
+      {
+         round_robin_.push_back(tenant_id);
+         round_robin_.pop_front();
+      }
+      return true;
+   }
+   return false;
+}
+
+std::vector<Task> FairShareTaskQueue::TakeAll()
+{
+   std::vector<Task> tasks;
+   tasks.reserve(size_);
+   for (auto tenant_id : round_robin_)
+   {
+      queues_[tenant_id].tasks.MoveTo(&tasks);
+   }
+   queues_.clear();
+   round_robin_.clear();
+   size_ = 0;
+   return tasks;
+}
+
+// ----------------------------------------------------------------------
+// NumaTaskQueue
+
+int NumaTaskQueue::Push(Task&& task)
+{
+   const int node_count = static_cast<int>(nodes_.size());
+   const int node = task.numa_node >= 0 && task.numa_node < node_count ? task.numa_node : 0;
+   nodes_[node].PushBack(std::move(task));
+   ++size_;
+   return -1;
+}
+
+bool NumaTaskQueue::Pop(int slot, Task* task)
+{
+   TaskList* source = &nodes_[slot % nodes_.size()];
+   if ( source->Empty() )
+   {
+      // Last resort, help the most backlogged node
+      source = &*std::max_element(nodes_.begin(), nodes_.end(), [](const TaskList& left, const TaskList& right)
+      {
+         return left.Size() < right.Size();
+      });
+      if ( source->Empty() )
+      {
+         return false;
+      }
+   }
+   source->PopFront(task);
+   --size_;
+   return true;
+}
+
+std::vector<Task> NumaTaskQueue::TakeAll()
+{
+   std::vector<Task> tasks;
+   tasks.reserve(size_);
+   for (auto& node : nodes_)
+   {
+      node.MoveTo(&tasks);
+   }
+   size_ = 0;
+   return tasks;
+}
+
+}  // namespace internal
+
+}  // namespace arrow
@@ -1,6 +1,11 @@
+#include <pthread.h>
+#include <sched.h>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
+#include <iostream>
 #include <list>
 #include <mutex>
 #include <string>
@@ -8,49 +13,172 @@
 #include <vector>
 
 #include "thread_pool.h"
+#include "bounded_mpmc_queue.h"
 #include "cancel.h"
+#include "cpu_topology.h"
 #include "io_util.h"
 #include "macros.h"
+#include "object_pool.h"
+#include "task_queue.h"
+#include "../../reclaim_x/epoch.h"
 
 namespace arrow 
 {
 
 Executor::~Executor() = default;
 
+using internal::Task;
+
 namespace 
 {
 
-struct Task 
+struct Worker
 {
+   std::thread thread;
 
-   // Task function, can only be called once. The detail of FnOnce<> please see functional.h
-   internal::FnOnce<void()> callable;
+   // Identifies the worker for the scheduling policy and the metrics, see TaskQueue
+   int slot = -1;
 
-   
-   StopToken stop_token;
+   // Parking slot of the worker, it waits there while it is on State::idle_workers_
+   std::condition_variable cv;
+   bool waiting = false;
+};
+
+/*
+   Brief :
+      The busy-polling side of a ThreadPool, see ThreadPool::EnableBusyPoll().
+*/
+struct BusyPoll
+{
+   explicit BusyPoll(size_t capacity) : tasks(capacity) {}
 
-   // Stop requested callback function.
-   Executor::StopCallback stop_callback;
+   internal::BoundedMpmcQueue<Task> tasks;
+
+   // Set once no submission can reach `tasks` anymore, the pollers then drain it and exit
+   std::atomic<bool> please_stop{false};
+
+   std::vector<std::thread> pollers;
 };
 
 }  // namespace
 
+static std::unique_ptr<internal::TaskQueue> MakeTaskQueue(const ThreadPool::SchedulingOptions& options,
+                                                          const internal::TenantTable* tenants, int numa_node_count)
+{
+   switch ( options.policy )
+   {
+      case SchedulingPolicy::NumaLocal:
+         return std::make_unique<internal::NumaTaskQueue>(numa_node_count);
+      case SchedulingPolicy::KeyAffinity:
+         return std::make_unique<internal::KeyAffinityTaskQueue>(options.affinity_max_backlog);
+      case SchedulingPolicy::EarliestDeadline:
+         return std::make_unique<internal::DeadlineTaskQueue>();
+      case SchedulingPolicy::Priority:
+         return std::make_unique<internal::PriorityTaskQueue>();
+      case SchedulingPolicy::FairShare:
+         return std::make_unique<internal::FairShareTaskQueue>(tenants);
+      case SchedulingPolicy::Fifo:
+      default:
+         return std::make_unique<internal::FifoTaskQueue>();
+   }
+}
+
+static std::vector<int> IndexCpusByNode(const std::vector<internal::NumaNode>& nodes)
+{
+   std::vector<int> cpu_node;
+   for (size_t i = 0; i < nodes.size(); i++)
+   {
+      for (int cpu : nodes[i].cpus)
+      {
+         if ( static_cast<size_t>(cpu) >= cpu_node.size() )
+         {
+            cpu_node.resize(cpu + 1, -1);
+         }
+         cpu_node[cpu] = static_cast<int>(i);
+      }
+   }
+   return cpu_node;
+}
+
 struct ThreadPool::State 
 {
    State() = default;
 
    std::mutex mutex_;
-   std::condition_variable cv_;
    std::condition_variable cv_shutdown_;
    std::condition_variable cv_idle_;
 
-   std::list<std::thread> workers_;
+   std::list<Worker> workers_;
 
    // Trashcan for finished threads
    std::vector<std::thread> finished_workers_;
 
+   // Worker owning each slot, nullptr for free slots
+   std::vector<Worker*> slot_workers_;
+
+   // Parked workers, the most recently parked one (with the warmest caches) on top
+   std::vector<Worker*> idle_workers_;
+
+   // Workers unparked which have not yet reacquired the mutex, they are on their way to the queue
+   int workers_waking_ = 0;
+
+   // Idle workers spinning before they park, they are watching events_ and don't need to be woken up
+   int workers_spinning_ = 0;
+
+   // Bumped whenever spinning workers should have a look at the pool
+   std::atomic<uint64_t> events_{0};
+
+   WaitOptions wait_options_;
+
+   // Where the workers run, and the CPUs worker slots are mapped to in order
+   AffinityOptions affinity_options_;
+   std::vector<int> affinity_cpus_;
+
+   // Moving average of the time between two submissions
+   std::chrono::nanoseconds submission_interval_{0};
+   std::chrono::steady_clock::time_point last_submission_;
+
+   // Options, bookkeeping and statistics of the tenants
+   internal::TenantTable tenants_;
+
+   // NUMA nodes of the process cpuset, worker slot s belongs to numa_nodes_[s % numa_nodes_.size()]
+   std::vector<internal::NumaNode> numa_nodes_ = internal::GetNumaNodes();
+
+   // Index in numa_nodes_ of each CPU, -1 for CPUs outside the process cpuset
+   std::vector<int> cpu_numa_node_ = IndexCpusByNode(numa_nodes_);
+
    // Pending tasks queue
-   std::deque<Task> pending_tasks_;
+   SchedulingOptions scheduling_options_;
+   std::unique_ptr<internal::TaskQueue> pending_tasks_ =
+      MakeTaskQueue(scheduling_options_, &tenants_, static_cast<int>(numa_nodes_.size()));
+
+   // Statistics, indexed by worker slot
+   std::vector<WorkerMetrics> worker_metrics_;
+
+   // Tasks picked up after their deadline, and those of them which were dropped
+   int64_t deadline_misses_ = 0;
+   int64_t deadline_drops_ = 0;
+
+   /*
+      Busy-polling mode, nullptr when disabled.
+      Submitters register in busy_poll_submitters_ before loading busy_poll_,
+         so that disabling the mode can tell when its submission queue has no producer left.
+   */
+   std::atomic<BusyPoll*> busy_poll_{nullptr};
+   std::atomic<int> busy_poll_submitters_{0};
+
+   // Tasks given to the pollers which are either queued or running, and tasks the pollers ran
+   std::atomic<int64_t> busy_poll_tasks_queued_or_running_{0};
+   std::atomic<int64_t> busy_polled_tasks_{0};
+
+   // Number of threads in WaitForIdle(), the pollers only take the mutex to notify them
+   std::atomic<int> idle_waiters_{0};
+
+   // Thread re-evaluating the default capacity, see StartCapacityMonitor()
+   std::thread capacity_monitor_;
+   std::condition_variable cv_capacity_monitor_;
+   std::chrono::milliseconds capacity_monitor_period_{0};
+   bool please_stop_capacity_monitor_ = false;
 
    // Desired number of threads
    int desired_capacity_ = 0;
@@ -65,16 +193,223 @@ struct ThreadPool::State
    bool quick_shutdown_ = false;
 };
 
+/*
+   Brief :
+      Unpark the given idle worker.
+*/
+static void WakeWorkerUnlocked(ThreadPool::State* state, Worker* worker)
+{
+   auto& idle_workers = state->idle_workers_;
+   idle_workers.erase(std::find(idle_workers.begin(), idle_workers.end(), worker));
+   worker->waiting = false;
+   ++state->workers_waking_;
+   worker->cv.notify_one();
+}
+
+/*
+   Brief :
+      Return the index in State::numa_nodes_ of the node the worker of the given slot belongs to.
+*/
+static int SlotNumaNode(const ThreadPool::State* state, int slot)
+{
+   return slot % static_cast<int>(state->numa_nodes_.size());
+}
+
+/*
+   Brief :
+      Unpark up to `count` idle workers, the most recently parked first.
+
+   Note :
+      With a numa_node (an index in State::numa_nodes_), workers of that node are preferred.
+*/
+static void WakeIdleWorkersUnlocked(ThreadPool::State* state, size_t count, int numa_node = -1)
+{
+   state->events_.fetch_add(1, std::memory_order_release);
+   auto& idle_workers = state->idle_workers_;
+   for (; count > 0 && !idle_workers.empty(); count--)
+   {
+      Worker* worker = idle_workers.back();
+      if ( numa_node >= 0 )
+      {
+         auto local = std::find_if(idle_workers.rbegin(), idle_workers.rend(), [&](const Worker* idle)
+         {
+            return SlotNumaNode(state, idle->slot) == numa_node;
+         });
+         if ( local != idle_workers.rend() )
+         {
+            worker = *local;
+         }
+      }
+      WakeWorkerUnlocked(state, worker);
+   }
+}
+
+/*
+   Brief :
+      Return the index in State::numa_nodes_ of the node with the given id, or else of the node of the calling thread.
+*/
+static int ResolveNumaNodeUnlocked(const ThreadPool::State* state, int node_id)
+{
+   const auto& nodes = state->numa_nodes_;
+   for (size_t i = 0; i < nodes.size(); i++)
+   {
+      if ( nodes[i].id == node_id )
+      {
+         return static_cast<int>(i);
+      }
+   }
+   const int cpu = sched_getcpu();
+   if ( cpu >= 0 && static_cast<size_t>(cpu) < state->cpu_numa_node_.size() && state->cpu_numa_node_[cpu] >= 0 )
+   {
+      return state->cpu_numa_node_[cpu];
+   }
+   return 0;
+}
+
+/*
+   Brief :
+      Busy-wait, then yield for a while, in the hope that a task comes before we have to park.
+
+   Return :
+      true if something happened that deserves a look at the pool, false if we should park.
+*/
+static bool SpinUnlocked(ThreadPool::State* state, int slot, std::unique_lock<std::mutex>& lock)
+{
+   using std::chrono::nanoseconds;
+
+   const ThreadPool::WaitOptions& options = state->wait_options_;
+   nanoseconds spin = options.spin_limit;
+   nanoseconds yield = options.yield_limit;
+   if ( options.adaptive )
+   {
+      const nanoseconds expected = state->submission_interval_;
+      if ( expected == nanoseconds(0) || expected > spin + yield )
+      {
+         return false;
+      }
+      spin = std::min(spin, 2 * expected);
+      yield = std::min(yield, 2 * expected - spin);
+   }
+   if ( spin + yield == nanoseconds(0) )
+   {
+      return false;
+   }
+
+   ++state->worker_metrics_[slot].spins;
+   const uint64_t events = state->events_.load(std::memory_order_acquire);
+   const auto event_happened = [&]() { return state->events_.load(std::memory_order_acquire) != events; };
+
+   ++state->workers_spinning_;
+   lock.unlock();
+
+   // Reading the clock is much more expensive than a pause, only do it once in a while
+   constexpr int kPausesPerClockRead = 64;
+   const auto start = std::chrono::steady_clock::now();
+   bool happened = false;
+   while ( !happened && std::chrono::steady_clock::now() - start < spin )
+   {
+      for (int i = 0; i < kPausesPerClockRead && !(happened = event_happened()); i++)
+      {
+         ARROW_CPU_PAUSE();
+      }
+   }
+   while ( !happened && std::chrono::steady_clock::now() - start < spin + yield )
+   {
+      std::this_thread::yield();
+      happened = event_happened();
+   }
+
+   lock.lock();
+   --state->workers_spinning_;
+
+   // A submission may have relied on us while we were waiting for the lock
+   return happened || event_happened();
+}
+
+/*
+   Brief :
+      Account for a task taken out of the queue by the worker of the given slot.
+
+   Return :
+      true if the task must be dropped instead of run.
+*/
+static bool StartTaskUnlocked(ThreadPool::State* state, int slot, const Task& task)
+{
+   const auto now = std::chrono::steady_clock::now();
+
+   ThreadPool::WorkerMetrics& metrics = state->worker_metrics_[slot];
+   ++metrics.tasks_executed;
+   const int cpu = sched_getcpu();
+   if ( metrics.cpu >= 0 && cpu != metrics.cpu )
+   {
+      ++metrics.migrations;
+   }
+   metrics.cpu = cpu;
+   if ( task.home_slot >= 0 )
+   {
+      ++metrics.keyed_tasks_executed;
+      if ( task.home_slot == slot )
+      {
+         ++metrics.affinity_hits;
+      }
+   }
+
+   // Tenants are only kept under FairShare, other policies would grow the table with every tenant id ever seen
+   if ( state->scheduling_options_.policy == SchedulingPolicy::FairShare )
+   {
+      internal::Tenant& tenant = state->tenants_[task.hints.tenant_id];
+      const auto queue_time = std::chrono::duration_cast<std::chrono::nanoseconds>(now - task.enqueue_time);
+      ++tenant.running;
+      ++tenant.tasks_started;
+      tenant.total_queue_time += queue_time;
+      tenant.max_queue_time = std::max(tenant.max_queue_time, queue_time);
+   }
+
+   if ( task.hints.deadline.has_value() && now > *task.hints.deadline )
+   {
+      ++state->deadline_misses_;
+      if ( state->scheduling_options_.drop_expired )
+      {
+         ++state->deadline_drops_;
+         return true;
+      }
+   }
+   return false;
+}
+
+/*
+   Brief :
+      Run the task, unless a stop was requested in which case its stop callback is invoked.
+*/
+static void RunTask(Task* task)
+{
+   // Check if there is a request to stop this task
+   if ( !task->stop_token.IsStopRequested() )
+   {
+      // If not, we invoke task function
+      std::move(task->callable)();
+   }
+   else if ( task->stop_callback )
+   {
+      std::move(task->stop_callback)(task->stop_token.Poll());
+   }
+}
+
 /*
    Brief :
       The worker loop is an independent function so that it can keep running after the ThreadPool is destroyed.
 */
-static void WorkerLoop(std::shared_ptr<ThreadPool::State> state, std::list<std::thread>::iterator it) 
+static void WorkerLoop(std::shared_ptr<ThreadPool::State> state, std::list<Worker>::iterator it) 
 {
    std::unique_lock<std::mutex> lock(state->mutex_);
 
    // Since we hold the lock, `it` now points to the correct thread object (LaunchWorkersUnlocked has exited)
-   DCHECK_EQ(std::this_thread::get_id(), it->get_id());
+   DCHECK_EQ(std::this_thread::get_id(), it->thread.get_id());
+   const int slot = it->slot;
+
+   // Were we unparked, or did we spin, since we last ran a task?
+   bool woken = false;
+   bool spun = false;
 
    // If too many threads, we should secede from the pool
    const auto should_secede = [&]() -> bool 
@@ -88,7 +423,7 @@ static void WorkerLoop(std::shared_ptr<ThreadPool::State> state, std::list<std::
       // So we only wait on the condition variable at the end of the loop.
 
       // Execute pending tasks if any
-      while ( !state->pending_tasks_.empty() && !state->quick_shutdown_ ) 
+      while ( !state->pending_tasks_->Empty() && !state->quick_shutdown_ ) 
       {
          // We check this opportunistically at each loop iteration since it releases the lock below.
          if ( should_secede() )
@@ -98,26 +433,46 @@ static void WorkerLoop(std::shared_ptr<ThreadPool::State> state, std::list<std::
 
          DCHECK_GE(state->tasks_queued_or_running_, 0);
          {
-            Task task = std::move(state->pending_tasks_.front());
-            state->pending_tasks_.pop_front();
-            StopToken* stop_token = &task.stop_token;
+            Task task;
+            // The remaining tasks may be reserved for other workers
+            if ( !state->pending_tasks_->Pop(slot, &task) )
+            {
+               break;
+            }
+
+            if ( spun )
+            {
+               ++state->worker_metrics_[slot].wakeups_avoided;
+            }
+            woken = spun = false;
+            // The policy may change while the task runs, remember whether StartTaskUnlocked counted it as running
+            const bool tenant_running = state->scheduling_options_.policy == SchedulingPolicy::FairShare;
+            const bool drop = StartTaskUnlocked(state.get(), slot, task);
+            const int64_t tenant_id = task.hints.tenant_id;
             lock.unlock();
 
-            // Check if there is a request to stop this task
-            if ( !stop_token->IsStopRequested() ) 
+            if ( drop )
             {
-               // If not, we invoke task function
-               std::move(task.callable)();
-            } 
-            else 
-            {  
-               if ( task.stop_callback ) 
+               // Running the task late is worthless to the caller
+               if ( task.stop_callback )
                {
-                  std::move(task.stop_callback)(stop_token->Poll());
+                  std::move(task.stop_callback)(Status::DeadlineExceeded("Task deadline exceeded"));
                }
             }
+            else
+            {
+               RunTask(&task);
+            }
             ARROW_UNUSED(std::move(task));  // release resources before waiting for lock
+            // Workers stay offline, since tasks may block : this only helps the nodes our tasks retired along
+            epoch_quiescent();
             lock.lock();
+
+            // This may let another task of the tenant run, we'll pick it up in the next iteration
+            if ( tenant_running )
+            {
+               --state->tenants_[tenant_id].running;
+            }
          }
 
          // For each scheduled task, the number of tasks will be reduced by 1
@@ -134,8 +489,32 @@ static void WorkerLoop(std::shared_ptr<ThreadPool::State> state, std::list<std::
          break;
       }
 
-      // Wait for next wakeup
-      state->cv_.wait(lock);
+      if ( woken )
+      {
+         // Someone else took the task we were woken for
+         ++state->worker_metrics_[slot].futile_wakeups;
+         woken = false;
+      }
+
+      // Only spin once per idle period, if it didn't bring us a task we park
+      if ( !spun )
+      {
+         spun = true;
+         if ( SpinUnlocked(state.get(), slot, lock) )
+         {
+            continue;
+         }
+      }
+      spun = false;
+
+      // Park until a waker takes us off the idle stack, our cached task blocks may serve the threads still spawning
+      internal::PoolFlushThreadCache();
+      state->idle_workers_.push_back(&*it);
+      it->waiting = true;
+      it->cv.wait(lock, [&] { return !it->waiting; });
+      --state->workers_waking_;
+      ++state->worker_metrics_[slot].wakeups;
+      woken = true;
 
    }// while loop
 
@@ -148,20 +527,196 @@ static void WorkerLoop(std::shared_ptr<ThreadPool::State> state, std::list<std::
          2) we can explicitly join() the trashcan threads to make sure all OS threads
                are exited before the ThreadPool is destroyed.  Otherwise subtle timing conditions can lead to false positives with Valgrind.
    */
-   DCHECK_EQ(std::this_thread::get_id(), it->get_id());
-   state->finished_workers_.push_back(std::move(*it));
+   DCHECK_EQ(std::this_thread::get_id(), it->thread.get_id());
+   state->finished_workers_.push_back(std::move(it->thread));
    state->workers_.erase(it);
+   state->slot_workers_[slot] = nullptr;
+   state->pending_tasks_->SetSlotLive(slot, false);
    if( state->please_shutdown_ ) 
    {
       // Notify the function waiting in Shutdown().
       state->cv_shutdown_.notify_one();
    }
+   else if ( !state->pending_tasks_->Empty() )
+   {
+      // Tasks reserved for this worker are up for grabs now
+      WakeIdleWorkersUnlocked(state.get(), 1);
+   }
+}
+
+/*
+   Brief :
+      Account for the end of a task given to the pollers.
+*/
+static void FinishBusyPollTask(ThreadPool::State* state)
+{
+   // Both sequentially consistent, so that either we see the waiter or the waiter sees the count drop to 0
+   if ( state->busy_poll_tasks_queued_or_running_.fetch_sub(1) == 1 && state->idle_waiters_.load() > 0 )
+   {
+      std::lock_guard<std::mutex> lock(state->mutex_);
+      state->cv_idle_.notify_all();
+   }
+}
+
+/*
+   Brief :
+      Hand a task over to the pollers, without taking the mutex.
+
+   Return :
+      false if the busy-polling mode is disabled or its queue is full, `task` is then left untouched.
+*/
+static bool SpawnBusyPoll(ThreadPool::State* state, Task* task)
+{
+   state->busy_poll_submitters_.fetch_add(1);
+   BusyPoll* busy_poll = state->busy_poll_.load();
+   bool queued = false;
+   if ( busy_poll != nullptr )
+   {
+      // Count the task before a poller can see it
+      state->busy_poll_tasks_queued_or_running_.fetch_add(1);
+      queued = busy_poll->tasks.TryPush(std::move(*task));
+      if ( !queued )
+      {
+         FinishBusyPollTask(state);
+      }
+   }
+   state->busy_poll_submitters_.fetch_sub(1, std::memory_order_release);
+   return queued;
+}
+
+/*
+   Brief :
+      Body of a poller of the busy-polling mode, it never sleeps and never takes the mutex on its way to a task.
+*/
+static void PollerLoop(std::shared_ptr<ThreadPool::State> state, BusyPoll* busy_poll)
+{
+   while (true)
+   {
+      // Like the workers, a poller stays offline and is quiescent at every turn
+      epoch_quiescent();
+      {
+         Task task;
+         if ( !busy_poll->tasks.TryPop(&task) )
+         {
+            if ( !busy_poll->please_stop.load(std::memory_order_acquire) )
+            {
+               ARROW_CPU_PAUSE();
+               continue;
+            }
+            // No producer is left, one last look tells whether the queue is drained
+            if ( !busy_poll->tasks.TryPop(&task) )
+            {
+               break;
+            }
+         }
+         RunTask(&task);
+         // Release resources before publishing the task as finished
+      }
+      state->busy_polled_tasks_.fetch_add(1, std::memory_order_relaxed);
+      FinishBusyPollTask(state.get());
+   }
+}
+
+/*
+   Brief :
+      Turn the busy-polling mode off, once the pollers ran every task given to them.
+
+   Note :
+      The lock is released while waiting for the pollers.
+*/
+static void StopBusyPollUnlocked(ThreadPool::State* state, std::unique_lock<std::mutex>& lock)
+{
+   BusyPoll* busy_poll = state->busy_poll_.exchange(nullptr);
+   if ( busy_poll == nullptr )
+   {
+      return;
+   }
+   lock.unlock();
+
+   // Submissions which loaded busy_poll before the exchange are a few instructions away from completion
+   while ( state->busy_poll_submitters_.load(std::memory_order_acquire) != 0 )
+   {
+      std::this_thread::yield();
+   }
+   busy_poll->please_stop.store(true, std::memory_order_release);
+   for (auto& poller : busy_poll->pollers)
+   {
+      poller.join();
+   }
+   delete busy_poll;
+
+   lock.lock();
+}
+
+/*
+   Brief :
+      Stop the capacity monitor if it runs.
+
+   Note :
+      The lock is released while waiting for the monitor to exit.
+*/
+static void StopCapacityMonitorUnlocked(ThreadPool::State* state, std::unique_lock<std::mutex>& lock)
+{
+   if ( !state->capacity_monitor_.joinable() )
+   {
+      return;
+   }
+   state->please_stop_capacity_monitor_ = true;
+   state->cv_capacity_monitor_.notify_one();
+   std::thread monitor = std::move(state->capacity_monitor_);
+   lock.unlock();
+   monitor.join();
+   lock.lock();
+   state->please_stop_capacity_monitor_ = false;
+}
+
+/*
+   Brief :
+      Restrict the given thread to the given CPUs.
+*/
+static bool PinThread(pthread_t thread, const std::vector<int>& cpus)
+{
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   for (int cpu : cpus)
+   {
+      CPU_SET(cpu, &set);
+   }
+   return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
+/*
+   Brief :
+      Return the CPUs the worker of the given slot should be pinned to, empty if it should not be pinned.
+*/
+static std::vector<int> SlotCpusUnlocked(ThreadPool::State* state, int slot)
+{
+   const std::vector<int>& cpus = state->affinity_cpus_;
+   switch ( state->affinity_options_.policy )
+   {
+      case AffinityPolicy::Compact:
+      case AffinityPolicy::Scatter:
+      case AffinityPolicy::Explicit:
+         return {cpus[slot % cpus.size()]};
+      case AffinityPolicy::Inherit:
+         return cpus;
+      case AffinityPolicy::NumaNode:
+         return state->numa_nodes_[SlotNumaNode(state, slot)].cpus;
+      case AffinityPolicy::None:
+      default:
+         return {};
+   }
 }
 
 void ThreadPool::WaitForIdle() 
 {
    std::unique_lock<std::mutex> lk(state_->mutex_);
-   state_->cv_idle_.wait(lk, [this] { return state_->tasks_queued_or_running_ == 0; });
+   state_->idle_waiters_.fetch_add(1);
+   state_->cv_idle_.wait(lk, [this] 
+   { 
+      return state_->tasks_queued_or_running_ == 0 && state_->busy_poll_tasks_queued_or_running_.load() == 0; 
+   });
+   state_->idle_waiters_.fetch_sub(1);
 }
 
 ThreadPool::ThreadPool() : 
@@ -192,9 +747,23 @@ void ThreadPool::ProtectAgainstFork()
       */
       int capacity = state_->desired_capacity_;
 
+      // The pollers and the capacity monitor don't survive fork() either, they are off in the child
+
       auto new_state = std::make_shared<ThreadPool::State>();
       new_state->please_shutdown_ = state_->please_shutdown_;
       new_state->quick_shutdown_ = state_->quick_shutdown_;
+      new_state->scheduling_options_ = state_->scheduling_options_;
+      new_state->wait_options_ = state_->wait_options_;
+      new_state->affinity_options_ = state_->affinity_options_;
+      new_state->affinity_cpus_ = state_->affinity_cpus_;
+      new_state->pending_tasks_ = MakeTaskQueue(new_state->scheduling_options_, &new_state->tenants_,
+                                                static_cast<int>(new_state->numa_nodes_.size()));
+      for (const auto& entry : state_->tenants_)
+      {
+         internal::Tenant& tenant = new_state->tenants_[entry.first];
+         tenant.weight = entry.second.weight;
+         tenant.max_concurrency = entry.second.max_concurrency;
+      }
 
       pid_ = current_pid;
       sp_state_ = new_state;
@@ -222,9 +791,10 @@ thread_local ThreadPool* current_thread_pool_ = nullptr;
 
 bool ThreadPool::OwnsThisThread() { return current_thread_pool_ == this; }
 
-void ThreadPool::LaunchWorkersUnlocked(int threads) 
+void ThreadPool::LaunchWorkersUnlocked(int threads, int preferred_slot) 
 {
    std::shared_ptr<State> state = sp_state_;
+   auto& slot_workers = state_->slot_workers_;
 
    for (int i = 0; i < threads; i++) 
    {
@@ -232,10 +802,32 @@ void ThreadPool::LaunchWorkersUnlocked(int threads)
 
       // Get the last element.
       auto it = --(state_->workers_.end());
-      *it = std::thread([this, state, it] 
+
+      // Take a free slot
+      int slot = preferred_slot;
+      if ( i > 0 || slot < 0 || (slot < static_cast<int>(slot_workers.size()) && slot_workers[slot] != nullptr) )
+      {
+         slot = static_cast<int>(std::find(slot_workers.begin(), slot_workers.end(), nullptr) - slot_workers.begin());
+      }
+      if ( slot >= static_cast<int>(slot_workers.size()) )
+      {
+         slot_workers.resize(slot + 1, nullptr);
+         state_->worker_metrics_.resize(slot_workers.size());
+      }
+      slot_workers[slot] = &*it;
+      it->slot = slot;
+      state_->worker_metrics_[slot].cpu = -1;
+      state_->pending_tasks_->SetSlotLive(slot, true);
+
+      it->thread = std::thread([this, state, it, cpus = SlotCpusUnlocked(state_, slot)] 
       {
          // Enable each thread to know which thread pool it belongs to
          current_thread_pool_ = this;
+         if ( !cpus.empty() )
+         {
+            // If the cpuset forbids it, the worker runs unpinned
+            ARROW_UNUSED(PinThread(pthread_self(), cpus));
+         }
          WorkerLoop(state, it);
       });
    }
@@ -260,7 +852,7 @@ Status ThreadPool::SetCapacity(int threads)
    state_->desired_capacity_ = threads;
 
    // See if we need to increase or decrease the number of running threads
-   const int required = std::min(static_cast<int>(state_->pending_tasks_.size()),
+   const int required = std::min(static_cast<int>(state_->pending_tasks_->Size()),
                                  threads - static_cast<int>(state_->workers_.size()));
    if ( required > 0 ) 
    {
@@ -269,8 +861,9 @@ Status ThreadPool::SetCapacity(int threads)
    } 
    else if (required < 0) 
    {
-      // Excess threads are running, wake them so that they stop
-      state_->cv_.notify_all();
+      // Excess threads are running, wake as many idle ones so that they stop.
+      // Busy ones will notice after their current task.
+      WakeIdleWorkersUnlocked(state_, state_->workers_.size() - threads);
    }
    return Status::OK();
 }
@@ -286,7 +879,7 @@ int ThreadPool::GetNumTasks()
 {
    ProtectAgainstFork();
    std::unique_lock<std::mutex> lock(state_->mutex_);
-   return state_->tasks_queued_or_running_;
+   return state_->tasks_queued_or_running_ + static_cast<int>(state_->busy_poll_tasks_queued_or_running_.load());
 }
 
 int ThreadPool::GetActualCapacity() 
@@ -309,16 +902,20 @@ Status ThreadPool::Shutdown(bool wait)
    state_->please_shutdown_ = true;
    state_->quick_shutdown_ = !wait;
 
+   // Tasks already given to the pollers are run even on a quick shutdown
+   StopBusyPollUnlocked(state_, lock);
+   StopCapacityMonitorUnlocked(state_, lock);
+
    // Wake up threads waiting on WorkLoop()
-   state_->cv_.notify_all();
+   WakeIdleWorkersUnlocked(state_, state_->idle_workers_.size());
    state_->cv_shutdown_.wait(lock, [this] { return state_->workers_.empty(); });
    if ( !state_->quick_shutdown_ ) 
    {
-      DCHECK_EQ(state_->pending_tasks_.size(), 0);
+      DCHECK_EQ(state_->pending_tasks_->Size(), 0);
    } 
    else 
    {
-      state_->pending_tasks_.clear();
+      ARROW_UNUSED(state_->pending_tasks_->TakeAll());
    }
    CollectFinishedWorkersUnlocked();
    return Status::OK();
@@ -326,8 +923,20 @@ Status ThreadPool::Shutdown(bool wait)
 
 Status ThreadPool::SpawnReal(TaskHints hints, internal::FnOnce<void()> task, StopToken stop_token, StopCallback&& stop_callback) 
 {
+   ProtectAgainstFork();
+   Task pending;
+   pending.callable = std::move(task);
+   pending.stop_token = std::move(stop_token);
+   pending.stop_callback = std::move(stop_callback);
+   pending.hints = hints;
+
+   // Fast path of the busy-polling mode, see EnableBusyPoll()
+   if ( state_->busy_poll_.load(std::memory_order_relaxed) != nullptr && SpawnBusyPoll(state_, &pending) )
+   {
+      return Status::OK();
+   }
+
    {
-      ProtectAgainstFork();
       std::lock_guard<std::mutex> lock(state_->mutex_);
       if ( state_->please_shutdown_) 
       {
@@ -336,23 +945,315 @@ Status ThreadPool::SpawnReal(TaskHints hints, internal::FnOnce<void()> task, Sto
       CollectFinishedWorkersUnlocked();
       state_->tasks_queued_or_running_++;
 
+      pending.enqueue_time = std::chrono::steady_clock::now();
+
+      // Track the arrival rate for adaptive spinning, with an exponential moving average of weight 1/8
+      if ( state_->last_submission_ != std::chrono::steady_clock::time_point() )
+      {
+         auto interval = pending.enqueue_time - state_->last_submission_;
+         state_->submission_interval_ += (interval - state_->submission_interval_) / 8;
+      }
+      state_->last_submission_ = pending.enqueue_time;
+      int preferred_slot = -1;
+      if ( hints.external_id >= 0 )
+      {
+         pending.home_slot = static_cast<int>(static_cast<uint64_t>(hints.external_id) % state_->desired_capacity_);
+         preferred_slot = pending.home_slot;
+      }
+      if ( state_->scheduling_options_.policy == SchedulingPolicy::NumaLocal )
+      {
+         pending.numa_node = ResolveNumaNodeUnlocked(state_, hints.numa_node);
+
+         // A new worker should join the sub-pool of the task's node
+         const auto& slot_workers = state_->slot_workers_;
+         preferred_slot = -1;
+         for (int slot = pending.numa_node; slot < state_->desired_capacity_; slot += static_cast<int>(state_->numa_nodes_.size()))
+         {
+            if ( slot >= static_cast<int>(slot_workers.size()) || slot_workers[slot] == nullptr )
+            {
+               preferred_slot = slot;
+               break;
+            }
+         }
+      }
+      const int numa_node = pending.numa_node;
+
       // If the current workers are less than tasks and desired capacity is more than workers.
       // That indicate we have more tasks need process.
+      bool launched = false;
       if ( static_cast<int>(state_->workers_.size()) < state_->tasks_queued_or_running_ &&
            state_->desired_capacity_ > static_cast<int>(state_->workers_.size()) ) 
       {
          // We can still spin up more workers so spin up a new worker
-         LaunchWorkersUnlocked(/*threads=*/1);
+         LaunchWorkersUnlocked(/*threads=*/1, preferred_slot);
+         launched = true;
+      }
+
+      const int reserved_slot = state_->pending_tasks_->Push(std::move(pending));
+      state_->events_.fetch_add(1, std::memory_order_release);
+      if ( reserved_slot >= 0 )
+      {
+         // The task can only be run by one worker, waking any other would be futile.
+         // If that worker is busy, it will get to the task by itself.
+         // If there is no such worker, the task is stranded and any worker may run it.
+         auto& slot_workers = state_->slot_workers_;
+         Worker* worker = reserved_slot < static_cast<int>(slot_workers.size()) ? slot_workers[reserved_slot] : nullptr;
+         if ( worker != nullptr )
+         {
+            if ( worker->waiting )
+            {
+               WakeWorkerUnlocked(state_, worker);
+            }
+            return Status::OK();
+         }
+      }
+
+      // Wake up exactly one parked worker, none if they are all busy
+      // or if enough workers are already on their way to the queue or spinning
+      if ( !launched &&
+           static_cast<int>(state_->pending_tasks_->Size()) > state_->workers_waking_ + state_->workers_spinning_ )
+      {
+         WakeIdleWorkersUnlocked(state_, 1, numa_node);
       }
-      state_->pending_tasks_.push_back(
-         {std::move(task), std::move(stop_token), std::move(stop_callback)});
    }
+   return Status::OK();
+}
 
-   // Wake up threads waiting on WorkLoop()
-   state_->cv_.notify_one();
+Status ThreadPool::SetSchedulingOptions(const SchedulingOptions& options)
+{
+   ProtectAgainstFork();
+   std::unique_lock<std::mutex> lock(state_->mutex_);
+   if ( state_->please_shutdown_ )
+   {
+      return Status::Invalid("operation forbidden during or after shutdown");
+   }
+
+   if ( options.affinity_max_backlog <= 0 )
+   {
+      return Status::Invalid("affinity_max_backlog must be > 0");
+   }
+
+   auto pending_tasks = MakeTaskQueue(options, &state_->tenants_, static_cast<int>(state_->numa_nodes_.size()));
+   for (const auto& worker : state_->workers_)
+   {
+      pending_tasks->SetSlotLive(worker.slot, true);
+   }
+   for (auto& task : state_->pending_tasks_->TakeAll())
+   {
+      ARROW_UNUSED(pending_tasks->Push(std::move(task)));
+   }
+   state_->pending_tasks_ = std::move(pending_tasks);
+   state_->scheduling_options_ = options;
+
+   // Reservations may have changed
+   WakeIdleWorkersUnlocked(state_, state_->idle_workers_.size());
+   return Status::OK();
+}
+
+Status ThreadPool::SetTenantOptions(int64_t tenant_id, const TenantOptions& options)
+{
+   ProtectAgainstFork();
+   std::unique_lock<std::mutex> lock(state_->mutex_);
+   if ( options.weight <= 0 )
+   {
+      return Status::Invalid("tenant weight must be > 0");
+   }
+
+   if ( options.max_concurrency < 0 )
+   {
+      return Status::Invalid("tenant max_concurrency must be >= 0");
+   }
+
+   internal::Tenant& tenant = state_->tenants_[tenant_id];
+   tenant.weight = options.weight;
+   tenant.max_concurrency = options.max_concurrency;
+
+   // Tasks held back by the previous concurrency limit may run now
+   WakeIdleWorkersUnlocked(state_, state_->pending_tasks_->Size());
    return Status::OK();
 }
 
+Status ThreadPool::SetWaitOptions(const WaitOptions& options)
+{
+   ProtectAgainstFork();
+   std::unique_lock<std::mutex> lock(state_->mutex_);
+   if ( options.spin_limit.count() < 0 || options.yield_limit.count() < 0 )
+   {
+      return Status::Invalid("wait limits must be >= 0");
+   }
+   state_->wait_options_ = options;
+   return Status::OK();
+}
+
+Status ThreadPool::SetAffinityOptions(const AffinityOptions& options)
+{
+   ProtectAgainstFork();
+   std::vector<int> cpus;
+   if ( options.policy == AffinityPolicy::Explicit )
+   {
+      if ( options.cpus.empty() )
+      {
+         return Status::Invalid("an explicit affinity needs at least one CPU");
+      }
+      for (int cpu : options.cpus)
+      {
+         if ( cpu < 0 || cpu >= CPU_SETSIZE )
+         {
+            return Status::Invalid("invalid CPU " + std::to_string(cpu));
+         }
+      }
+      cpus = options.cpus;
+   }
+   else if ( options.policy != AffinityPolicy::None && options.policy != AffinityPolicy::NumaNode )
+   {
+      const std::vector<internal::CpuInfo> allowed = internal::GetAllowedCpus();
+      if ( allowed.empty() )
+      {
+         return Status::Invalid("cannot read the process cpuset");
+      }
+      if ( options.policy == AffinityPolicy::Compact )
+      {
+         cpus = internal::CompactCpuOrder(allowed);
+      }
+      else if ( options.policy == AffinityPolicy::Scatter )
+      {
+         cpus = internal::ScatterCpuOrder(allowed);
+      }
+      else
+      {
+         for (const auto& info : allowed)
+         {
+            cpus.push_back(info.cpu);
+         }
+      }
+   }
+
+   std::unique_lock<std::mutex> lock(state_->mutex_);
+   if ( state_->please_shutdown_ )
+   {
+      return Status::Invalid("operation forbidden during or after shutdown");
+   }
+   state_->affinity_options_ = options;
+   state_->affinity_cpus_ = std::move(cpus);
+
+   // Unpinning a worker means letting it run anywhere in the process cpuset
+   std::vector<int> unpinned;
+   if ( options.policy == AffinityPolicy::None && !state_->workers_.empty() )
+   {
+      for (const auto& info : internal::GetAllowedCpus())
+      {
+         unpinned.push_back(info.cpu);
+      }
+   }
+   for (auto& worker : state_->workers_)
+   {
+      const std::vector<int> slot_cpus = SlotCpusUnlocked(state_, worker.slot);
+      ARROW_UNUSED(PinThread(worker.thread.native_handle(), slot_cpus.empty() ? unpinned : slot_cpus));
+   }
+   return Status::OK();
+}
+
+Status ThreadPool::EnableBusyPoll(const BusyPollOptions& options)
+{
+   ProtectAgainstFork();
+   std::unique_lock<std::mutex> lock(state_->mutex_);
+   if ( state_->please_shutdown_ )
+   {
+      return Status::Invalid("operation forbidden during or after shutdown");
+   }
+
+   if ( state_->busy_poll_.load() != nullptr )
+   {
+      return Status::Invalid("busy polling is already enabled");
+   }
+
+   if ( options.cpus.empty() || options.queue_capacity == 0 )
+   {
+      return Status::Invalid("busy polling needs at least one CPU and a queue capacity > 0");
+   }
+
+   for (int cpu : options.cpus)
+   {
+      if ( cpu < 0 || cpu >= CPU_SETSIZE )
+      {
+         return Status::Invalid("invalid CPU " + std::to_string(cpu));
+      }
+   }
+
+   auto busy_poll = std::make_unique<BusyPoll>(options.queue_capacity);
+   std::shared_ptr<State> state = sp_state_;
+   Status status;
+   for (int cpu : options.cpus)
+   {
+      busy_poll->pollers.emplace_back([this, state, busy_poll = busy_poll.get()]
+      {
+         current_thread_pool_ = this;
+         PollerLoop(state, busy_poll);
+      });
+      if ( !PinThread(busy_poll->pollers.back().native_handle(), {cpu}) )
+      {
+         status = Status::Invalid("cannot pin a poller to CPU " + std::to_string(cpu));
+         break;
+      }
+   }
+
+   if ( !status.ok() )
+   {
+      // The queue was never published, the pollers have nothing to drain
+      busy_poll->please_stop.store(true, std::memory_order_release);
+      for (auto& poller : busy_poll->pollers)
+      {
+         poller.join();
+      }
+      return status;
+   }
+
+   state_->busy_poll_.store(busy_poll.release());
+   return Status::OK();
+}
+
+Status ThreadPool::DisableBusyPoll()
+{
+   ProtectAgainstFork();
+   std::unique_lock<std::mutex> lock(state_->mutex_);
+   BusyPoll* busy_poll = state_->busy_poll_.load();
+   if ( busy_poll == nullptr )
+   {
+      return Status::Invalid("busy polling is not enabled");
+   }
+
+   for (const auto& poller : busy_poll->pollers)
+   {
+      if ( poller.get_id() == std::this_thread::get_id() )
+      {
+         return Status::Invalid("busy polling cannot be disabled from a poller");
+      }
+   }
+
+   StopBusyPollUnlocked(state_, lock);
+   return Status::OK();
+}
+
+ThreadPool::Metrics ThreadPool::GetMetrics()
+{
+   ProtectAgainstFork();
+   std::unique_lock<std::mutex> lock(state_->mutex_);
+   Metrics metrics;
+   metrics.workers = state_->worker_metrics_;
+   metrics.deadline_misses = state_->deadline_misses_;
+   metrics.deadline_drops = state_->deadline_drops_;
+   metrics.busy_polled_tasks = state_->busy_polled_tasks_.load(std::memory_order_relaxed);
+   for (const auto& entry : state_->tenants_)
+   {
+      const internal::Tenant& tenant = entry.second;
+      TenantMetrics& tenant_metrics = metrics.tenants[entry.first];
+      tenant_metrics.tasks_started = tenant.tasks_started;
+      tenant_metrics.total_queue_time = tenant.total_queue_time;
+      tenant_metrics.max_queue_time = tenant.max_queue_time;
+   }
+   return metrics;
+}
+
 std::optional<std::shared_ptr<ThreadPool>> ThreadPool::Make(int threads) 
 {
    auto pool = std::shared_ptr<ThreadPool>(new ThreadPool());
@@ -402,7 +1303,8 @@ int ThreadPool::DefaultCapacity()
    capacity = ParseOMPEnvVar("OMP_NUM_THREADS");
    if ( capacity == 0 )
    {
-      capacity = std::thread::hardware_concurrency();
+      // In a container or under taskset, fewer CPUs than the machine has
+      capacity = internal::GetAvailableCpuCount();
    }
 
    // OMP_THREAD_LIMIT is an environment variable used to set the maximum number of threads used in the entire program
@@ -421,6 +1323,114 @@ int ThreadPool::DefaultCapacity()
    return capacity;
 }
 
+Status ThreadPool::StartCapacityMonitor(std::chrono::milliseconds period)
+{
+   ProtectAgainstFork();
+   std::unique_lock<std::mutex> lock(state_->mutex_);
+   if ( state_->please_shutdown_ )
+   {
+      return Status::Invalid("operation forbidden during or after shutdown");
+   }
+
+   if ( period.count() <= 0 )
+   {
+      return Status::Invalid("capacity monitor period must be > 0");
+   }
+
+   // The lock is released while stopping, another monitor may have been started meanwhile
+   while ( state_->capacity_monitor_.joinable() )
+   {
+      StopCapacityMonitorUnlocked(state_, lock);
+   }
+   if ( state_->please_shutdown_ )
+   {
+      return Status::Invalid("operation forbidden during or after shutdown");
+   }
+   state_->capacity_monitor_period_ = period;
+
+   // Shutdown() stops the monitor before the pool goes away
+   State* state = state_;
+   state_->capacity_monitor_ = std::thread([this, state]
+   {
+      int last_capacity = DefaultCapacity();
+      std::unique_lock<std::mutex> lock(state->mutex_);
+      while ( true )
+      {
+         state->cv_capacity_monitor_.wait_for(lock, state->capacity_monitor_period_,
+                                              [state] { return state->please_stop_capacity_monitor_; });
+         if ( state->please_stop_capacity_monitor_ )
+         {
+            break;
+         }
+
+         // Reading the cgroup files doesn't need the lock
+         lock.unlock();
+         const int capacity = DefaultCapacity();
+         if ( capacity != last_capacity )
+         {
+            last_capacity = capacity;
+            ARROW_UNUSED(SetCapacity(capacity));
+         }
+         lock.lock();
+      }
+   });
+   return Status::OK();
+}
+
+Status ThreadPool::StopCapacityMonitor()
+{
+   ProtectAgainstFork();
+   std::unique_lock<std::mutex> lock(state_->mutex_);
+   if ( !state_->capacity_monitor_.joinable() )
+   {
+      return Status::Invalid("the capacity monitor is not running");
+   }
+   StopCapacityMonitorUnlocked(state_, lock);
+   return Status::OK();
+}
+
+ThreadPool::AffinityOptions ThreadPool::DefaultAffinityOptions()
+{
+   AffinityOptions options;
+   auto result = GetEnvVar("ARROW_CPU_AFFINITY");
+   if ( !result.has_value() )
+   {
+      return options;
+   }
+
+   const std::string& value = *result;
+   if ( value == "compact" )
+   {
+      options.policy = AffinityPolicy::Compact;
+   }
+   else if ( value == "scatter" )
+   {
+      options.policy = AffinityPolicy::Scatter;
+   }
+   else if ( value == "inherit" )
+   {
+      options.policy = AffinityPolicy::Inherit;
+   }
+   else if ( value == "numa" )
+   {
+      options.policy = AffinityPolicy::NumaNode;
+   }
+   else if ( value != "none" )
+   {
+      auto cpus = internal::ParseCpuList(value);
+      if ( cpus.has_value() && !cpus->empty() )
+      {
+         options.policy = AffinityPolicy::Explicit;
+         options.cpus = *std::move(cpus);
+      }
+      else
+      {
+         std::cerr << "Invalid ARROW_CPU_AFFINITY value, workers are not pinned" << std::endl;
+      }
+   }
+   return options;
+}
+
 // Helper for the singleton pattern
 std::shared_ptr<ThreadPool> ThreadPool::MakeCpuThreadPool() 
 {
@@ -429,6 +1439,7 @@ std::shared_ptr<ThreadPool> ThreadPool::MakeCpuThreadPool()
    {
       Status().Abort("Failed to create global CPU thread pool");
    }
+   ARROW_UNUSED((*maybe_pool)->SetAffinityOptions(ThreadPool::DefaultAffinityOptions()));
    return *std::move(maybe_pool);
 }
 